@@ -0,0 +1,170 @@
+#ifndef BENCHMARKCORE_H
+#define BENCHMARKCORE_H
+
+#include "benchmark/benchmark.h"
+#include "knncolle_kmknn/knncolle_kmknn.hpp"
+
+#include <vector>
+#include <random>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+// Synthetic datasets, identified by the first argument of each benchmark.
+enum class Dataset : int {
+    UNIFORM = 0, // uniformly distributed in the unit hypercube.
+    MIXTURE = 1, // mixture of 20 tight Gaussian clusters.
+    DUPLICATES = 2 // each observation is one of a small number of distinct points.
+};
+
+inline const char* dataset_name(Dataset type) {
+    switch (type) {
+        case Dataset::UNIFORM: return "uniform";
+        case Dataset::MIXTURE: return "mixture";
+        default: return "duplicates";
+    }
+}
+
+inline std::vector<double> simulate(Dataset type, int ndim, int nobs, std::uint64_t seed = 42) {
+    std::mt19937_64 rng(seed);
+    std::vector<double> output(static_cast<std::size_t>(ndim) * static_cast<std::size_t>(nobs));
+
+    if (type == Dataset::UNIFORM) {
+        std::uniform_real_distribution<double> distr;
+        for (auto& x : output) {
+            x = distr(rng);
+        }
+
+    } else if (type == Dataset::MIXTURE) {
+        constexpr int ncomponents = 20;
+        std::uniform_real_distribution<double> udistr(0, 10);
+        std::vector<double> centers(ncomponents * ndim);
+        for (auto& x : centers) {
+            x = udistr(rng);
+        }
+        std::normal_distribution<double> ndistr(0, 0.5);
+        std::uniform_int_distribution<int> cdistr(0, ncomponents - 1);
+        for (int o = 0; o < nobs; ++o) {
+            const auto chosen = centers.data() + cdistr(rng) * ndim;
+            for (int d = 0; d < ndim; ++d) {
+                output[static_cast<std::size_t>(o) * ndim + d] = chosen[d] + ndistr(rng);
+            }
+        }
+
+    } else {
+        const int nunique = std::max(1, nobs / 50);
+        std::uniform_real_distribution<double> distr;
+        for (int o = 0; o < nunique; ++o) {
+            for (int d = 0; d < ndim; ++d) {
+                output[static_cast<std::size_t>(o) * ndim + d] = distr(rng);
+            }
+        }
+        std::uniform_int_distribution<int> cdistr(0, nunique - 1);
+        for (int o = nunique; o < nobs; ++o) {
+            const auto chosen = output.data() + static_cast<std::size_t>(cdistr(rng)) * ndim;
+            std::copy_n(chosen, ndim, output.data() + static_cast<std::size_t>(o) * ndim);
+        }
+    }
+
+    return output;
+}
+
+// Euclidean distance that counts the number of distance evaluations.
+// This disables the specialized kernels in the KMKNN index, so it should only be used to count evaluations and not for timing.
+class CountingEuclideanDistance final : public knncolle::DistanceMetric<double, double> {
+public:
+    double raw(std::size_t num_dimensions, const double* x, const double* y) const {
+        ++count;
+        return my_base.raw(num_dimensions, x, y);
+    }
+
+    double normalize(double raw) const {
+        return my_base.normalize(raw);
+    }
+
+    double denormalize(double norm) const {
+        return my_base.denormalize(norm);
+    }
+
+public:
+    mutable std::size_t count = 0;
+
+private:
+    knncolle::EuclideanDistance<double, double> my_base;
+};
+
+// Parameters shared by all benchmarks: dataset type, number of dimensions, number of observations, and 'power' as a percentage.
+struct BenchmarkParams {
+    Dataset type;
+    int ndim;
+    int nobs;
+    double power;
+};
+
+inline BenchmarkParams parse_params(const benchmark::State& state) {
+    BenchmarkParams output;
+    output.type = static_cast<Dataset>(state.range(0));
+    output.ndim = state.range(1);
+    output.nobs = state.range(2);
+    output.power = state.range(3) / 100.0;
+    return output;
+}
+
+inline void add_params(benchmark::internal::Benchmark* b) {
+    b->ArgNames({ "dataset", "ndim", "nobs", "power" });
+    b->ArgsProduct({ { 0, 1, 2 }, { 5, 20, 50 }, { 10000 }, { 50 } });
+    for (int power : { 30, 40, 60 }) {
+        b->Args({ 1, 20, 10000, power });
+    }
+}
+
+inline auto build_index(
+    const std::vector<double>& data,
+    const BenchmarkParams& params,
+    std::shared_ptr<const knncolle::DistanceMetric<double, double> > data_metric,
+    std::shared_ptr<const knncolle::DistanceMetric<double, double> > center_metric)
+{
+    knncolle_kmknn::KmknnBuilder<int, double, double> builder(std::move(data_metric), std::move(center_metric));
+    builder.get_options().power = params.power;
+    return builder.build_known_unique(knncolle::SimpleMatrix<int, double>(params.ndim, params.nobs, data.data()));
+}
+
+// Number of query points used to count distance evaluations.
+// This is done in a separate (untimed) pass with an index built from CountingEuclideanDistance metrics.
+constexpr int num_counted_queries = 1000;
+
+// Reports the mean number of distance evaluations per query, separately for the query-to-center and query-to-subject distances.
+// If the search counters are enabled, the mean of each counter per query is also reported.
+// 'run' should accept a searcher and a query index, and perform the same search as the timed loop.
+template<class Run_>
+void count_evaluations(benchmark::State& state, const std::vector<double>& data, const BenchmarkParams& params, Run_ run) {
+    auto data_metric = std::make_shared<CountingEuclideanDistance>();
+    auto center_metric = std::make_shared<CountingEuclideanDistance>();
+    auto index = build_index(data, params, data_metric, center_metric);
+    auto searcher = index->initialize_known();
+
+    data_metric->count = 0;
+    center_metric->count = 0;
+    const int nqueries = std::min(num_counted_queries, params.nobs);
+    for (int q = 0; q < nqueries; ++q) {
+        run(*searcher, q);
+    }
+
+    state.counters["center_evals"] = static_cast<double>(center_metric->count) / nqueries;
+    state.counters["subject_evals"] = static_cast<double>(data_metric->count) / nqueries;
+
+    if constexpr(knncolle_kmknn::search_counters_enabled) {
+        const auto& counters = searcher->get_counters();
+        state.counters["super_center_evals"] = static_cast<double>(counters.super_centers_evaluated) / nqueries;
+        state.counters["centers_skipped"] = static_cast<double>(counters.centers_skipped) / nqueries;
+        state.counters["annulus_skipped"] = static_cast<double>(counters.annulus_skipped) / nqueries;
+        state.counters["subjects_scanned"] = static_cast<double>(counters.subjects_scanned) / nqueries;
+        state.counters["pivot_skipped"] = static_cast<double>(counters.pivot_skipped) / nqueries;
+        state.counters["queue_additions"] = static_cast<double>(counters.queue_additions) / nqueries;
+        state.counters["tightenings"] = static_cast<double>(counters.threshold_tightenings) / nqueries;
+        state.counters["trims"] = static_cast<double>(counters.binary_search_trims) / nqueries;
+    }
+}
+
+#endif
@@ -0,0 +1,42 @@
+#include "BenchmarkCore.h"
+
+static void BM_Build(benchmark::State& state) {
+    const auto params = parse_params(state);
+    const auto data = simulate(params.type, params.ndim, params.nobs);
+    knncolle::SimpleMatrix<int, double> mat(params.ndim, params.nobs, data.data());
+
+    auto eucdist = std::make_shared<knncolle::EuclideanDistance<double, double> >();
+    knncolle_kmknn::KmknnBuilder<int, double, double> builder(eucdist, eucdist);
+    builder.get_options().power = params.power;
+
+    for (auto _ : state) {
+        std::unique_ptr<knncolle::Prebuilt<int, double, double> > ptr(builder.build_known_raw(mat));
+        benchmark::DoNotOptimize(ptr.get());
+    }
+
+    state.SetItemsProcessed(state.iterations() * params.nobs);
+    state.SetLabel(dataset_name(params.type));
+}
+
+BENCHMARK(BM_Build)->Apply(add_params)->Unit(benchmark::kMillisecond);
+
+static void BM_BuildSubsampled(benchmark::State& state) {
+    const auto params = parse_params(state);
+    const auto data = simulate(params.type, params.ndim, params.nobs);
+    knncolle::SimpleMatrix<int, double> mat(params.ndim, params.nobs, data.data());
+
+    auto eucdist = std::make_shared<knncolle::EuclideanDistance<double, double> >();
+    knncolle_kmknn::KmknnBuilder<int, double, double> builder(eucdist, eucdist);
+    builder.get_options().power = params.power;
+    builder.get_options().kmeans_subsample_size = params.nobs / 10;
+
+    for (auto _ : state) {
+        std::unique_ptr<knncolle::Prebuilt<int, double, double> > ptr(builder.build_known_raw(mat));
+        benchmark::DoNotOptimize(ptr.get());
+    }
+
+    state.SetItemsProcessed(state.iterations() * params.nobs);
+    state.SetLabel(dataset_name(params.type));
+}
+
+BENCHMARK(BM_BuildSubsampled)->Apply(add_params)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,80 @@
+#include "BenchmarkCore.h"
+
+#include <vector>
+#include <cstddef>
+
+// Comparing the virtual raw() calls to the blocked and tiled kernels, for a fixed number of subjects per query.
+// This isolates the cost of the distance calculations from the rest of the search.
+constexpr int num_kernel_subjects = 1024;
+
+static void add_kernel_params(benchmark::internal::Benchmark* b) {
+    b->ArgNames({ "ndim" });
+    for (int ndim : { 5, 20, 50, 200 }) {
+        b->Args({ ndim });
+    }
+}
+
+static void BM_KernelRaw(benchmark::State& state) {
+    const int ndim = state.range(0);
+    const auto data = simulate(Dataset::UNIFORM, ndim, num_kernel_subjects);
+    const auto query = simulate(Dataset::UNIFORM, ndim, 1, /* seed = */ 1234);
+    std::unique_ptr<knncolle::DistanceMetric<double, double> > metric(new knncolle::EuclideanDistance<double, double>);
+
+    std::vector<double> output(num_kernel_subjects);
+    for (auto _ : state) {
+        for (int s = 0; s < num_kernel_subjects; ++s) {
+            output[s] = metric->raw(ndim, query.data(), data.data() + static_cast<std::size_t>(s) * ndim);
+        }
+        benchmark::DoNotOptimize(output.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * num_kernel_subjects);
+}
+
+BENCHMARK(BM_KernelRaw)->Apply(add_kernel_params);
+
+static void BM_KernelBlocked(benchmark::State& state) {
+    const int ndim = state.range(0);
+    const auto data = simulate(Dataset::UNIFORM, ndim, num_kernel_subjects);
+    const auto query = simulate(Dataset::UNIFORM, ndim, 1, /* seed = */ 1234);
+    knncolle::EuclideanDistance<double, double> metric;
+
+    std::vector<double> output(num_kernel_subjects);
+    for (auto _ : state) {
+        knncolle_kmknn::compute_raw_distances(knncolle_kmknn::DistanceKind::EUCLIDEAN, metric, ndim, query.data(), data.data(), num_kernel_subjects, output.data());
+        benchmark::DoNotOptimize(output.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * num_kernel_subjects);
+}
+
+BENCHMARK(BM_KernelBlocked)->Apply(add_kernel_params);
+
+static void BM_KernelTiled(benchmark::State& state) {
+    const int ndim = state.range(0);
+    const auto data = simulate(Dataset::UNIFORM, ndim, num_kernel_subjects);
+    const auto query = simulate(Dataset::UNIFORM, ndim, 1, /* seed = */ 1234);
+
+    // Transposing the subjects into tiles, as done by KmknnOptions::tile_subjects.
+    constexpr std::size_t block = knncolle_kmknn::kernel_block_size<double>();
+    const std::size_t stride = knncolle_kmknn::tile_stride<double, double>(ndim);
+    const std::size_t ntiles = num_kernel_subjects / block;
+    std::vector<double, knncolle_kmknn::AlignedAllocator<double> > tiles(ntiles * stride);
+    for (int s = 0; s < num_kernel_subjects; ++s) {
+        for (int d = 0; d < ndim; ++d) {
+            tiles[(s / block) * stride + d * block + s % block] = data[static_cast<std::size_t>(s) * ndim + d];
+        }
+    }
+
+    std::vector<double> output(num_kernel_subjects);
+    for (auto _ : state) {
+        for (std::size_t t = 0; t < ntiles; ++t) {
+            knncolle_kmknn::compute_tiled_raw_distances(knncolle_kmknn::DistanceKind::EUCLIDEAN, ndim, query.data(), tiles.data() + t * stride, output.data() + t * block);
+        }
+        benchmark::DoNotOptimize(output.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * num_kernel_subjects);
+}
+
+BENCHMARK(BM_KernelTiled)->Apply(add_kernel_params);
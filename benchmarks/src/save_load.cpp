@@ -0,0 +1,84 @@
+#include "BenchmarkCore.h"
+
+#include <filesystem>
+#include <string>
+
+// Format of the saved index, identified by the last argument of each benchmark.
+enum class Format : int {
+    DIRECTORY = 0, // one file per array, via knncolle::Prebuilt::save().
+    SINGLE_FILE = 1, // single file, via save_kmknn_prebuilt_file().
+    MAPPED = 2 // single file that is memory-mapped during loading.
+};
+
+static void add_format_params(benchmark::internal::Benchmark* b) {
+    b->ArgNames({ "dataset", "ndim", "nobs", "power", "format" });
+    b->ArgsProduct({ { 1 }, { 5, 50 }, { 10000, 100000 }, { 50 }, { 0, 1, 2 } });
+}
+
+static std::filesystem::path make_path(Format format) {
+    auto path = std::filesystem::temp_directory_path() / ("knncolle_kmknn_benchmark_" + std::to_string(static_cast<int>(format)));
+    std::filesystem::remove_all(path);
+    if (format == Format::DIRECTORY) {
+        std::filesystem::create_directory(path);
+    }
+    return path;
+}
+
+template<class Index_>
+static void save(const Index_& index, Format format, const std::filesystem::path& path) {
+    if (format == Format::DIRECTORY) {
+        index.save(path);
+    } else {
+        knncolle_kmknn::save_kmknn_prebuilt_file(index, path);
+    }
+}
+
+static void BM_Save(benchmark::State& state) {
+    const auto params = parse_params(state);
+    const auto format = static_cast<Format>(state.range(4));
+    const auto data = simulate(params.type, params.ndim, params.nobs);
+    auto eucdist = std::make_shared<knncolle::EuclideanDistance<double, double> >();
+    auto index = build_index(data, params, eucdist, eucdist);
+    const auto path = make_path(format);
+
+    for (auto _ : state) {
+        save(*index, format, path);
+    }
+
+    state.SetBytesProcessed(state.iterations() * static_cast<std::int64_t>(data.size() * sizeof(double)));
+    state.SetLabel(dataset_name(params.type));
+    std::filesystem::remove_all(path);
+}
+
+BENCHMARK(BM_Save)->Apply(add_format_params)->Unit(benchmark::kMillisecond);
+
+static void BM_Load(benchmark::State& state) {
+    knncolle::register_load_euclidean_distance<double, double>();
+
+    const auto params = parse_params(state);
+    const auto format = static_cast<Format>(state.range(4));
+    const auto data = simulate(params.type, params.ndim, params.nobs);
+    auto eucdist = std::make_shared<knncolle::EuclideanDistance<double, double> >();
+    auto index = build_index(data, params, eucdist, eucdist);
+    const auto path = make_path(format);
+    save(*index, format, path);
+
+    knncolle_kmknn::KmknnLoadOptions lopt;
+    lopt.memory_map = (format == Format::MAPPED);
+
+    for (auto _ : state) {
+        std::unique_ptr<knncolle::Prebuilt<int, double, double> > loaded;
+        if (format == Format::DIRECTORY) {
+            loaded.reset(knncolle_kmknn::load_kmknn_prebuilt<int, double, double>(path, lopt));
+        } else {
+            loaded.reset(knncolle_kmknn::load_kmknn_prebuilt_file<int, double, double>(path, lopt));
+        }
+        benchmark::DoNotOptimize(loaded.get());
+    }
+
+    state.SetBytesProcessed(state.iterations() * static_cast<std::int64_t>(data.size() * sizeof(double)));
+    state.SetLabel(dataset_name(params.type));
+    std::filesystem::remove_all(path);
+}
+
+BENCHMARK(BM_Load)->Apply(add_format_params)->Unit(benchmark::kMillisecond);
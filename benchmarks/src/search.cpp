@@ -0,0 +1,117 @@
+#include "BenchmarkCore.h"
+
+#include <algorithm>
+#include <vector>
+
+constexpr int num_neighbors = 10;
+
+static void BM_SearchIndex(benchmark::State& state) {
+    const auto params = parse_params(state);
+    const auto data = simulate(params.type, params.ndim, params.nobs);
+    auto eucdist = std::make_shared<knncolle::EuclideanDistance<double, double> >();
+    auto index = build_index(data, params, eucdist, eucdist);
+    auto searcher = index->initialize_known();
+
+    std::vector<int> indices;
+    std::vector<double> distances;
+    int q = 0;
+    for (auto _ : state) {
+        searcher->search(q, num_neighbors, &indices, &distances);
+        benchmark::DoNotOptimize(indices.data());
+        q = (q + 1) % params.nobs;
+    }
+
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(dataset_name(params.type));
+    count_evaluations(state, data, params, [&](auto& counted, int i) -> void {
+        counted.search(i, num_neighbors, &indices, &distances);
+    });
+}
+
+BENCHMARK(BM_SearchIndex)->Apply(add_params);
+
+static void BM_SearchPointer(benchmark::State& state) {
+    const auto params = parse_params(state);
+    const auto data = simulate(params.type, params.ndim, params.nobs);
+    auto eucdist = std::make_shared<knncolle::EuclideanDistance<double, double> >();
+    auto index = build_index(data, params, eucdist, eucdist);
+    auto searcher = index->initialize_known();
+
+    // Queries are drawn from the same distribution but are not in the index.
+    const auto queries = simulate(params.type, params.ndim, params.nobs, /* seed = */ 1234);
+
+    std::vector<int> indices;
+    std::vector<double> distances;
+    int q = 0;
+    for (auto _ : state) {
+        searcher->search(queries.data() + static_cast<std::size_t>(q) * params.ndim, num_neighbors, &indices, &distances);
+        benchmark::DoNotOptimize(indices.data());
+        q = (q + 1) % params.nobs;
+    }
+
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(dataset_name(params.type));
+    count_evaluations(state, data, params, [&](auto& counted, int i) -> void {
+        counted.search(queries.data() + static_cast<std::size_t>(i) * params.ndim, num_neighbors, &indices, &distances);
+    });
+}
+
+BENCHMARK(BM_SearchPointer)->Apply(add_params);
+
+// Choosing a threshold that captures roughly 'num_neighbors' neighbors for a typical query,
+// i.e., the median distance to the 'num_neighbors'-th nearest neighbor across a subset of observations.
+template<class Searcher_>
+double choose_threshold(Searcher_& searcher, int nobs) {
+    std::vector<double> kth;
+    std::vector<int> indices;
+    std::vector<double> distances;
+    const int nqueries = std::min(nobs, 100);
+    for (int q = 0; q < nqueries; ++q) {
+        searcher.search(q, num_neighbors, &indices, &distances);
+        kth.push_back(distances.back());
+    }
+    std::nth_element(kth.begin(), kth.begin() + kth.size() / 2, kth.end());
+    return kth[kth.size() / 2];
+}
+
+template<bool report_>
+void search_all(benchmark::State& state) {
+    const auto params = parse_params(state);
+    const auto data = simulate(params.type, params.ndim, params.nobs);
+    auto eucdist = std::make_shared<knncolle::EuclideanDistance<double, double> >();
+    auto index = build_index(data, params, eucdist, eucdist);
+    auto searcher = index->initialize_known();
+    const double threshold = choose_threshold(*searcher, params.nobs);
+
+    std::vector<int> indices;
+    std::vector<double> distances;
+    auto iptr = (report_ ? &indices : NULL);
+    auto dptr = (report_ ? &distances : NULL);
+
+    int q = 0;
+    std::size_t total = 0;
+    for (auto _ : state) {
+        total += searcher->search_all(q, threshold, iptr, dptr);
+        q = (q + 1) % params.nobs;
+    }
+    benchmark::DoNotOptimize(total);
+
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(dataset_name(params.type));
+    state.counters["neighbors"] = static_cast<double>(total) / state.iterations();
+    count_evaluations(state, data, params, [&](auto& counted, int i) -> void {
+        counted.search_all(i, threshold, iptr, dptr);
+    });
+}
+
+static void BM_SearchAllCount(benchmark::State& state) {
+    search_all<false>(state);
+}
+
+BENCHMARK(BM_SearchAllCount)->Apply(add_params);
+
+static void BM_SearchAllReport(benchmark::State& state) {
+    search_all<true>(state);
+}
+
+BENCHMARK(BM_SearchAllReport)->Apply(add_params);
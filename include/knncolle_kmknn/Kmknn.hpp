@@ -2,6 +2,11 @@
 #define KNNCOLLE_KMKNN_KMKNN_HPP
 
 #include "utils.hpp"
+#include "kernels.hpp"
+#include "store.hpp"
+#include "container.hpp"
+#include "counters.hpp"
+#include "convert.hpp"
 
 #include "knncolle/knncolle.hpp"
 #include "kmeans/kmeans.hpp"
@@ -16,6 +21,12 @@
 #include <type_traits>
 #include <string>
 #include <filesystem>
+#include <array>
+#include <numeric>
+#include <functional>
+#include <cstdint>
+#include <random>
+#include <fstream>
 
 /**
  * @file knncolle_kmknn.hpp
@@ -66,6 +77,9 @@ std::function<void(const std::filesystem::path&)>& custom_save_for_kmknn_kmeansf
  * @tparam KmeansMatrix_ Class of the input data matrix for **kmeans**.
  * This should satisfy the `kmeans::Matrix` interface, most typically a `kmeans::SimpleMatrix`.
  * (Note that this is a different class from the `knncolle::Matrix` interface!)
+ * If `Data_` and `KmeansData_` differ, setting this to `kmeans::Matrix` allows user-supplied k-means algorithms to convert each observation on demand;
+ * otherwise, user-supplied algorithms require a converted copy of the entire dataset.
+ * (The default algorithms always convert on demand.)
  */
 template<
     typename Index_,
@@ -95,6 +109,228 @@ struct KmknnOptions {
      * If NULL, defaults to `kmeans::RefineHartiganWong`.
      */
     std::shared_ptr<kmeans::Refine<KmeansIndex_, KmeansData_, KmeansCluster_, KmeansFloat_, KmeansMatrix_> > refine_algorithm;
+
+    /**
+     * Number of threads to use for index construction.
+     * This is used to compute the distances from each observation to its assigned center and to sort the observations within each cluster.
+     * It is also passed to the default k-means algorithms when `initialize_algorithm` or `refine_algorithm` are NULL.
+     * The constructed index is the same regardless of the number of threads.
+     */
+    int num_threads = 1;
+
+    /**
+     * Whether to reorder the observations in place during index construction.
+     * This uses a serial series of swaps that does not require any extra memory but involves random accesses to the data.
+     * If false, the observations are instead copied into a new buffer in their clustered order, using `num_threads` threads.
+     * This is faster for large datasets at the cost of (temporarily) doubling the memory usage for the data.
+     */
+    bool reorder_in_place = true;
+
+    /**
+     * Number of dimensions between checks for early termination of a distance calculation.
+     * When computing the distance to each candidate neighbor, the partial distance is compared to the current search threshold after every block of dimensions,
+     * and the calculation is abandoned if the partial distance already exceeds the threshold.
+     * This is most useful for high-dimensional data where most candidates can be rejected after only a few blocks.
+     * If zero, early termination is disabled.
+     *
+     * This option is only used for `knncolle::EuclideanDistance` and `knncolle::ManhattanDistance`, for which the partial distance is guaranteed to be monotonic.
+     * It has no effect on the search results.
+     */
+    std::size_t early_abandon_block = 0;
+
+    /**
+     * Whether to store an 8-bit scalar-quantized copy of the data for filtering candidates during the search.
+     * For each candidate, the distance to its quantized coordinates is compared to the search threshold after accounting for the maximum quantization error.
+     * Only candidates that pass this filter are compared to the query with the full-precision data.
+     * This reduces memory bandwidth during the search as most candidates only require a pass over the quantized data.
+     *
+     * This option is only used for `knncolle::EuclideanDistance` and `knncolle::ManhattanDistance`, for which the quantization error can be bounded.
+     * It has no effect on the search results.
+     */
+    bool quantize = false;
+
+    /**
+     * Whether to permute the dimensions in order of decreasing variance before clustering.
+     * The permutation is stored in the index and applied to each query, so the dimensions that contribute most to the distances are processed first.
+     * This allows `early_abandon_block` to reject candidates after fewer dimensions, especially for anisotropic data where most of the variance lies in a few dimensions.
+     *
+     * This option is only used for `knncolle::EuclideanDistance` and `knncolle::ManhattanDistance`, which are invariant to the order of the dimensions.
+     * The search results are unchanged, aside from round-off error due to the different order of summation across dimensions.
+     */
+    bool reorder_dimensions = false;
+
+    /**
+     * Number of pivots per cluster, for filtering candidates during the search.
+     * Each cluster's pivots are chosen from its observations by farthest-first traversal, starting from the observation that is farthest from the center.
+     * The distance from each observation to each of its cluster's pivots is stored in the index.
+     * When a cluster is searched, the distances from the query to its pivots are computed,
+     * and any observation that must be further than the current threshold (by the triangle inequality) is skipped without computing its full distance.
+     * This is most useful for high-dimensional data with large clusters, where each full distance calculation is expensive.
+     * If zero, no pivots are used.
+     *
+     * This option has no effect on the search results.
+     */
+    std::size_t num_pivots = 0;
+
+    /**
+     * Whether to store an additional copy of the data where each cluster's observations are transposed into tiles.
+     * Each tile holds the coordinates of a block of consecutive observations in dimension-major order, starting on a 64-byte boundary and padded to a full block.
+     * This allows the distance kernels to load each dimension with contiguous (and aligned) vector loads across the observations of a tile,
+     * rather than gathering each dimension from observations that are `num_dim` elements apart.
+     * The number of observations per tile is the same as that used by the distance kernels, see `KNNCOLLE_KMKNN_SIMD_BYTES`.
+     * Tiles are not used for candidates that need to be considered individually for `early_abandon_block`, `quantize` or `num_pivots`.
+     *
+     * This option is only used for `knncolle::EuclideanDistance` and `knncolle::ManhattanDistance`.
+     * It roughly doubles the memory usage of the index but has no effect on the search results.
+     */
+    bool tile_subjects = false;
+
+    /**
+     * Maximum imbalance in the cluster sizes after adding new observations with `KmknnPrebuilt::add()`.
+     * If the largest cluster contains more than `recluster_imbalance` times the mean number of observations per cluster,
+     * the entire index is rebuilt with a fresh k-means clustering of all observations.
+     * If zero, the index is never rebuilt by `KmknnPrebuilt::add()`.
+     */
+    double recluster_imbalance = 0;
+
+    /**
+     * Power of the number of cluster centers, to define the number of super-centers.
+     * If positive, the cluster centers are themselves clustered with k-means into super-centers,
+     * and the search uses the triangle inequality to skip entire groups of centers without computing the distance from the query to each center.
+     * This is most useful for very large datasets with many cluster centers.
+     * If zero, no super-centers are used.
+     *
+     * The super-centers are computed with `kmeans::InitializeKmeanspp` and `kmeans::RefineHartiganWong`, using `num_threads` threads.
+     * This option has no effect on the search results.
+     */
+    double super_center_power = 0;
+
+    /**
+     * Number of observations to use for k-means clustering.
+     * If positive and less than the number of observations, the centers are computed from a random subsample of this many observations,
+     * after which each observation is assigned to its closest center in a single pass with `num_threads` threads.
+     * This is much faster than clustering all observations for large datasets, at the cost of looser clusters (and thus less pruning during the search).
+     * It is automatically increased to the number of centers if it is smaller.
+     * If zero, all observations are used for clustering.
+     *
+     * This option has no effect on the search results.
+     */
+    Index_ kmeans_subsample_size = 0;
+
+    /**
+     * Seed for the random number generator used to choose the subsample when `kmeans_subsample_size` is positive.
+     */
+    std::uint64_t kmeans_subsample_seed = 42;
+
+    /**
+     * Maximum number of observations in each cluster.
+     * If positive, any cluster with more observations is split by k-means clustering of its observations (with `kmeans::InitializeKmeanspp` and `kmeans::RefineHartiganWong`),
+     * and this is repeated until all clusters are no larger than `max_cluster_size`.
+     * This bounds the number of subjects that need to be scanned for a query near a large cluster, at the cost of more centers.
+     * If zero, the cluster sizes are not capped.
+     *
+     * The cap is only applied during index construction, i.e., clusters may grow beyond the cap when observations are added with `KmknnPrebuilt::add()`.
+     * This option has no effect on the search results.
+     */
+    Index_ max_cluster_size = 0;
+
+    /**
+     * Candidate values of `power` for automatic tuning of the number of cluster centers.
+     * If non-empty, `power` is ignored and is instead chosen from these candidates.
+     *
+     * For each candidate, an index is built from a random subsample of observations, with the number of centers chosen to preserve the average number of observations per cluster.
+     * A random subset of the subsampled observations are used as queries for a k-nearest neighbor search,
+     * and the number of query-to-center and query-to-subject distance calculations is recorded.
+     * The candidate with the fewest distance calculations per query is used to build the final index.
+     * The chosen value is recorded in the index and can be retrieved with `KmknnPrebuilt::get_power()`.
+     */
+    std::vector<double> candidate_powers;
+
+    /**
+     * Number of observations to subsample for each candidate in `candidate_powers`.
+     * If this is greater than the number of observations, all observations are used.
+     */
+    Index_ tuning_subsample_size = 10000;
+
+    /**
+     * Number of subsampled observations to use as queries for each candidate in `candidate_powers`.
+     */
+    Index_ tuning_num_queries = 200;
+
+    /**
+     * Number of nearest neighbors to search for in each query, when tuning with `candidate_powers`.
+     * This should be set to the typical number of neighbors in the actual searches.
+     */
+    Index_ tuning_num_neighbors = 10;
+
+    /**
+     * Seed for the random number generator used to choose the subsample and queries when tuning with `candidate_powers`.
+     */
+    std::uint64_t tuning_seed = 42;
+};
+
+/**
+ * @brief Options for approximate searches with `KmknnPrebuilt::initialize_known()`.
+ *
+ * By default, the search is exact.
+ * Setting either of the options below trades some accuracy for speed in the k-nearest neighbor search,
+ * i.e., `knncolle::Searcher::search()` and `KmknnSearcher::search_batch()`.
+ * Note that `knncolle::Searcher::search_all()` is always exact, as its results are defined by the user-supplied threshold.
+ */
+struct KmknnSearchOptions {
+    /**
+     * Maximum number of cluster centers to visit for each query.
+     * Clusters are visited in order of increasing distance from the query to their centers, so only the `max_centers_visited` nearest clusters are searched.
+     * If zero, there is no limit on the number of visited centers.
+     */
+    std::size_t max_centers_visited = 0;
+
+    /**
+     * Relative error in the distances to the reported neighbors.
+     * The triangle inequality bounds are computed after dividing the current distance threshold by `1 + epsilon`, allowing more clusters and subjects to be skipped.
+     * The distance to each reported neighbor is no greater than `1 + epsilon` times the distance to the corresponding true neighbor.
+     * If zero, the bounds are exact.
+     */
+    double epsilon = 0;
+};
+
+/**
+ * @brief Options for streaming index construction with `KmknnBuilder::build_streaming_raw()`.
+ */
+struct KmknnStreamingOptions {
+    /**
+     * Size of the buffer for holding observations during construction, in bytes.
+     * Larger buffers reduce the number of seeks when writing the reordered data, and increase the default size of the subsample for computing the cluster centers.
+     * The buffer always holds at least one observation.
+     */
+    std::size_t buffer_size = static_cast<std::size_t>(1) << 28;
+};
+
+/**
+ * @brief k-nearest neighbor graph from `KmknnPrebuilt::build_knn_graph()`.
+ *
+ * The graph is stored in a compressed sparse row format, where the neighbors of each observation are stored contiguously.
+ *
+ * @tparam Index_ Integer type for the observation indices.
+ * @tparam Distance_ Floating-point type for the distances.
+ */
+template<typename Index_, typename Distance_>
+struct KmknnNeighborGraph {
+    /**
+     * Vector of length equal to the number of observations plus 1.
+     * The neighbors of observation `i` are stored in `indices` and `distances` from positions `pointers[i]` to `pointers[i + 1]`.
+     */
+    std::vector<std::size_t> pointers;
+
+    /**
+     * Indices of the nearest neighbors of each observation, sorted by increasing distance.
+     */
+    std::vector<Index_> indices;
+
+    /**
+     * Distances to the nearest neighbors of each observation, sorted in increasing order.
+     */
+    std::vector<Distance_> distances;
 };
 
 /**
@@ -103,11 +339,26 @@ struct KmknnOptions {
 template<typename Index_, typename Data_, typename Distance_, class DistanceMetricData_, class KmeansFloat_, class DistanceMetricCenter_>
 class KmknnPrebuilt;
 
-template<typename Index_, typename Data_, typename Distance_, class DistanceMetricData_, class KmeansFloat_, class DistanceMetricCenter_>
+// 'TallyEvaluations_' is only true for the searchers used by KmknnPrebuilt to tune the number of centers, so that the tally has no cost for the other searches.
+template<typename Index_, typename Data_, typename Distance_, class DistanceMetricData_, class KmeansFloat_, class DistanceMetricCenter_, bool TallyEvaluations_ = false>
 class KmknnSearcher final : public knncolle::Searcher<Index_, Data_, Distance_> {
 public:
-    KmknnSearcher(const KmknnPrebuilt<Index_, Data_, Distance_, DistanceMetricData_, KmeansFloat_, DistanceMetricCenter_>& parent) : my_parent(parent) {
+    KmknnSearcher(const KmknnPrebuilt<Index_, Data_, Distance_, DistanceMetricData_, KmeansFloat_, DistanceMetricCenter_>& parent, const KmknnSearchOptions& options = KmknnSearchOptions()) :
+        my_parent(parent),
+        my_max_centers_visited(options.max_centers_visited),
+        my_threshold_scale(1 / (1 + options.epsilon))
+    {
+        if (!(options.epsilon >= 0)) {
+            throw std::runtime_error("'epsilon' should be non-negative");
+        }
         my_center_order.reserve(my_parent.my_sizes.size());
+        my_max_radius = my_parent.max_radius();
+
+        const auto& super_radius = my_parent.my_super_radius;
+        my_max_super_radius = (super_radius.empty() ? 0 : *std::max_element(super_radius.begin(), super_radius.end()));
+        sanisizer::resize(my_super_distances, super_radius.size());
+        my_super_order.reserve(super_radius.size());
+        sanisizer::resize(my_center_distances, my_parent.my_sizes.size());
         if constexpr(needs_conversion) {
             sanisizer::resize(my_query_conversion_buffer, my_parent.my_dim);
         }
@@ -118,11 +369,53 @@ private:
     knncolle::NeighborQueue<Index_, Distance_> my_nearest;
     std::vector<std::pair<Distance_, Index_> > my_all_neighbors;
     std::vector<std::pair<Distance_, Index_> > my_center_order;
+    Distance_ my_max_radius;
+
+    // Settings for approximate searches in search_nn(). In exact mode, 'my_max_centers_visited' is zero and 'my_threshold_scale' is 1,
+    // so the pruning threshold is unchanged (as multiplication by 1 is exact).
+    std::size_t my_max_centers_visited;
+    Distance_ my_threshold_scale;
+
+    bool reached_max_centers(std::size_t visited) const {
+        return my_max_centers_visited && visited >= my_max_centers_visited;
+    }
+
+    // Counters are mutable so that they can be updated in the const helper methods.
+    mutable KmknnSearchCounters my_counters;
+
+    // Total number of distance calculations for centers and subjects, used by KmknnPrebuilt to tune the number of centers.
+    mutable std::size_t my_num_evaluations = 0;
+
+    void tally_evaluations(std::size_t n) const {
+        if constexpr(TallyEvaluations_) {
+            my_num_evaluations += n;
+        }
+    }
+
+    static void count(std::size_t& counter, std::size_t n = 1) {
+        if constexpr(search_counters_enabled) {
+            counter += n;
+        }
+    }
+
+    // Normalized threshold to use in the triangle inequality bounds during search_nn().
+    Distance_ pruning_threshold(Distance_ threshold_raw) const {
+        return my_parent.my_metric_center->normalize(threshold_raw) * my_threshold_scale;
+    }
+
+    std::vector<Distance_> my_super_distances;
+    std::vector<std::pair<Distance_, std::size_t> > my_super_order;
+    Distance_ my_max_super_radius;
+    std::vector<Distance_> my_center_distances;
+    std::vector<Distance_> my_quantized_query;
 
     // Converting Data_ to KmeansFloat_ if we need to.
     static constexpr bool needs_conversion = !std::is_same<KmeansFloat_, Data_>::value;
     typename std::conditional<needs_conversion, std::vector<KmeansFloat_>, bool>::type my_query_conversion_buffer; 
 
+    // Permuting the dimensions of user-supplied queries to match the stored data, if the dimensions were reordered.
+    std::vector<Data_> my_query_permutation_buffer;
+
     const KmeansFloat_* sanitize_query(const Data_* query) {
         if constexpr(needs_conversion) {
             auto conv_buffer = my_query_conversion_buffer.data();
@@ -147,106 +440,485 @@ private:
     }
 
 private:
+    void compute_center_distances(const KmeansFloat_* query_san, std::size_t first_center, std::size_t last_center, Distance_* output) const {
+        count(my_counters.centers_evaluated, last_center - first_center);
+        tally_evaluations(last_center - first_center);
+        compute_raw_distances(
+            my_parent.my_center_kind,
+            *(my_parent.my_metric_center),
+            my_parent.my_dim,
+            query_san,
+            my_parent.my_centers.data() + sanisizer::product_unsafe<std::size_t>(first_center, my_parent.my_dim),
+            last_center - first_center,
+            output
+        );
+    }
+
+    // Computes the distances to all subjects in [firstsubj, lastsubj) of cluster 'center' and calls 'process(s, dist_raw)' on each subject in order.
+    // Subjects are processed in blocks to take advantage of the specialized kernels for the stock distances.
+    // 'threshold_raw' is only used for early abandonment and filtering, so any reported distance greater than 'threshold_raw' may not be accurate.
+    // Note that 'threshold_raw' is a reference as it may be modified by 'process'.
+    template<class Process_>
+    void scan_subjects(const Data_* query, std::size_t center, Index_ firstsubj, Index_ lastsubj, const Distance_& threshold_raw, Process_ process) {
+        constexpr std::size_t block = kernel_block_size<Distance_>();
+        std::array<Distance_, block> buffer;
+        const bool can_abandon = my_parent.my_early_abandon_block > 0 && my_parent.my_data_kind != DistanceKind::OTHER;
+        const bool can_filter = !my_parent.my_quantized_scale.empty() && my_parent.my_data_kind != DistanceKind::OTHER;
+        Distance_ filter_threshold_raw = std::numeric_limits<Distance_>::quiet_NaN(), filter_bound_raw = 0;
+        count(my_counters.subjects_scanned, lastsubj - firstsubj);
+        tally_evaluations(lastsubj - firstsubj);
+
+        // The query-to-pivot distances are only computed once we need to check a subject against a finite threshold.
+        const auto num_pivots = my_parent.my_num_pivots;
+        const bool can_pivot = num_pivots > 0;
+        bool pivots_computed = false;
+        Distance_ pivot_threshold_raw = std::numeric_limits<Distance_>::quiet_NaN(), pivot_threshold = 0;
+
+        // Deleted subjects are skipped entirely, i.e., they are never passed to 'process'.
+        // The bounds from 'my_dist_to_centroid' are still valid as they only need to be satisfied by the remaining subjects.
+        const auto& deleted = my_parent.my_deleted;
+
+        while (firstsubj < lastsubj) {
+            if (std::isinf(threshold_raw) || (!can_abandon && !can_filter && !can_pivot)) {
+                if (my_parent.my_tiled) {
+                    // Computing distances for the entire tile containing 'firstsubj', but only reporting those for subjects in [firstsubj, lastsubj).
+                    const auto position = firstsubj - my_parent.my_offsets[center];
+                    const std::size_t lane = position % block;
+                    compute_tiled_raw_distances(
+                        my_parent.my_data_kind,
+                        my_parent.my_dim,
+                        query,
+                        my_parent.my_tiles.data() + sanisizer::product_unsafe<std::size_t>(my_parent.my_tile_offsets[center] + position / block, my_parent.my_tile_stride),
+                        buffer.data()
+                    );
+                    const auto end = lane + std::min<std::size_t>(block - lane, lastsubj - firstsubj);
+                    for (std::size_t b = lane; b < end; ++b) {
+                        if (deleted.empty() || !deleted[firstsubj]) {
+                            process(firstsubj, buffer[b]);
+                        }
+                        ++firstsubj;
+                    }
+                    continue;
+                }
+
+                const auto num = std::min<std::size_t>(block, lastsubj - firstsubj);
+                compute_raw_distances(
+                    my_parent.my_data_kind,
+                    *(my_parent.my_metric_data),
+                    my_parent.my_dim,
+                    query,
+                    my_parent.my_data.data() + sanisizer::product_unsafe<std::size_t>(firstsubj, my_parent.my_dim),
+                    num,
+                    buffer.data()
+                );
+                for (std::size_t b = 0; b < num; ++b) {
+                    if (deleted.empty() || !deleted[firstsubj]) {
+                        process(firstsubj, buffer[b]);
+                    }
+                    ++firstsubj;
+                }
+                continue;
+            }
+
+            if (!deleted.empty() && deleted[firstsubj]) {
+                ++firstsubj;
+                continue;
+            }
+
+            if (can_pivot) {
+                // By the triangle inequality, the distance from the query to a subject is no less than the difference in their distances to any pivot.
+                // So if any difference exceeds the threshold, we can skip the subject without examining its coordinates.
+                // We slightly inflate the threshold to protect against round-off error in the distance calculations.
+                if (!pivots_computed) {
+                    compute_pivot_distances(query, center);
+                    pivots_computed = true;
+                }
+                if (threshold_raw != pivot_threshold_raw) {
+                    pivot_threshold_raw = threshold_raw;
+                    pivot_threshold = my_parent.my_metric_data->normalize(threshold_raw) * (1 + my_parent.my_pivot_tolerance);
+                }
+
+                const auto subj2pivots = my_parent.my_pivot_distances.data() + sanisizer::product_unsafe<std::size_t>(firstsubj, num_pivots);
+                bool skip = false;
+                for (I<decltype(num_pivots)> p = 0; p < num_pivots; ++p) {
+                    const Distance_ query2pivot = my_query_pivot_distances[p], subj2pivot = subj2pivots[p];
+                    if (std::abs(query2pivot - subj2pivot) > pivot_threshold + (query2pivot + subj2pivot) * my_parent.my_pivot_tolerance) {
+                        skip = true;
+                        break;
+                    }
+                }
+                if (skip) {
+                    count(my_counters.pivot_skipped);
+                    process(firstsubj, std::numeric_limits<Distance_>::infinity());
+                    ++firstsubj;
+                    continue;
+                }
+            }
+
+            if (can_filter) {
+                // By the triangle inequality, the distance from the query to a subject is no less than the distance to its quantized coordinates minus the quantization error.
+                // So if the latter exceeds the threshold, we can skip the subject without examining its full-precision coordinates.
+                // We slightly inflate the bound to protect against round-off error in the distance calculations.
+                if (threshold_raw != filter_threshold_raw) {
+                    filter_threshold_raw = threshold_raw;
+                    const Distance_ threshold = my_parent.my_metric_data->normalize(threshold_raw);
+                    filter_bound_raw = my_parent.my_metric_data->denormalize((threshold + my_parent.my_quantized_error) * (1 + my_parent.my_quantized_tolerance));
+                }
+
+                const Distance_ approx_raw = compute_quantized_raw_distance(
+                    my_parent.my_data_kind,
+                    my_parent.my_dim,
+                    my_quantized_query.data(),
+                    my_parent.my_quantized.data() + sanisizer::product_unsafe<std::size_t>(firstsubj, my_parent.my_dim),
+                    my_parent.my_quantized_scale.data()
+                );
+                if (approx_raw * (1 - my_parent.my_quantized_tolerance) > filter_bound_raw) {
+                    process(firstsubj, std::numeric_limits<Distance_>::infinity());
+                    ++firstsubj;
+                    continue;
+                }
+            }
+
+            const auto subject = my_parent.my_data.data() + sanisizer::product_unsafe<std::size_t>(firstsubj, my_parent.my_dim);
+            Distance_ dist;
+            if (can_abandon) {
+                dist = compute_raw_distance_early_abandon(
+                    my_parent.my_data_kind,
+                    *(my_parent.my_metric_data),
+                    my_parent.my_dim,
+                    query,
+                    subject,
+                    my_parent.my_early_abandon_block,
+                    threshold_raw
+                );
+            } else {
+                compute_raw_distances(my_parent.my_data_kind, *(my_parent.my_metric_data), my_parent.my_dim, query, subject, 1, &dist);
+            }
+            process(firstsubj, dist);
+            ++firstsubj;
+        }
+    }
+
+    std::vector<Distance_> my_query_pivot_distances;
+
+    void compute_pivot_distances(const Data_* query, std::size_t center) {
+        const auto num_pivots = my_parent.my_num_pivots;
+        my_query_pivot_distances.resize(num_pivots);
+        compute_raw_distances(
+            my_parent.my_data_kind,
+            *(my_parent.my_metric_data),
+            my_parent.my_dim,
+            query,
+            my_parent.my_pivots.data() + sanisizer::product_unsafe<std::size_t>(center * num_pivots, my_parent.my_dim),
+            num_pivots,
+            my_query_pivot_distances.data()
+        );
+        for (auto& d : my_query_pivot_distances) {
+            d = my_parent.my_metric_data->normalize(d);
+        }
+        tally_evaluations(num_pivots);
+    }
+
+    void prepare_quantized_query(const Data_* query) {
+        if (!my_parent.my_quantized_scale.empty()) {
+            my_quantized_query.resize(my_parent.my_dim);
+            for (std::size_t d = 0; d < my_parent.my_dim; ++d) {
+                my_quantized_query[d] = static_cast<Distance_>(query[d]) - my_parent.my_quantized_min[d];
+            }
+        }
+    }
+
+private:
+    void compute_super_distances(const KmeansFloat_* query_san) {
+        count(my_counters.super_centers_evaluated, my_super_distances.size());
+        tally_evaluations(my_super_distances.size());
+        compute_raw_distances(
+            my_parent.my_center_kind,
+            *(my_parent.my_metric_center),
+            my_parent.my_dim,
+            query_san,
+            my_parent.my_super_centers.data(),
+            my_super_distances.size(),
+            my_super_distances.data()
+        );
+    }
+
+    // Visits the super-centers in order of increasing distance from the query, and only computes the query-to-center distances for super-centers that might contain neighbors.
+    void search_nn_hierarchical(const Data_* query) {
+        const auto query_san = sanitize_query(query);
+        prepare_quantized_query(query);
+
+        compute_super_distances(query_san);
+        const auto nsuper = my_super_distances.size();
+        my_super_order.clear();
+        for (I<decltype(nsuper)> g = 0; g < nsuper; ++g) {
+            my_super_order.emplace_back(my_super_distances[g], g);
+        }
+
+        const auto order_begin = my_super_order.begin();
+        auto order_end = my_super_order.end();
+        const std::greater<std::pair<Distance_, std::size_t> > comp;
+        std::make_heap(order_begin, order_end, comp);
+
+        const auto& super_offsets = my_parent.my_super_offsets;
+        const auto& super_radius = my_parent.my_super_radius;
+        Distance_ threshold_raw = std::numeric_limits<Distance_>::infinity();
+        std::size_t visited = 0;
+        while (order_begin != order_end && !reached_max_centers(visited)) {
+            std::pop_heap(order_begin, order_end, comp);
+            --order_end;
+            const auto& cursuper = *order_end;
+            const auto g = cursuper.second;
+
+            // Same logic as in search_nn_cluster(), where the super-center's radius is the largest distance from the super-center to any of its subjects.
+            if (!std::isinf(threshold_raw)) {
+                const Distance_ threshold = pruning_threshold(threshold_raw);
+                const Distance_ lower_bd = my_parent.my_metric_center->normalize(cursuper.first) - threshold;
+                if (my_max_super_radius < lower_bd) {
+                    break;
+                }
+                if (super_radius[g] < lower_bd) {
+                    count(my_counters.centers_skipped, super_offsets[g + 1] - super_offsets[g]);
+                    continue;
+                }
+            }
+
+            const auto first = super_offsets[g], last = super_offsets[g + 1];
+            compute_center_distances(query_san, first, last, my_center_distances.data() + first);
+            my_center_order.clear();
+            for (auto c = first; c < last; ++c) {
+                my_center_order.emplace_back(my_center_distances[c], c);
+            }
+            std::sort(my_center_order.begin(), my_center_order.end());
+            for (const auto& curcent : my_center_order) {
+                if (reached_max_centers(visited)) {
+                    break;
+                }
+                search_nn_cluster(query, curcent.second, curcent.first, threshold_raw);
+                ++visited;
+            }
+        }
+    }
+
     void search_nn(const Data_* query) {
-        // Computing distances to all centers and sorting them.
-        // The aim is to go through the nearest centers first, to try to get the shortest threshold (i.e., 'nearest.limit()') possible at the start;
-        // this allows us to skip searches of the later clusters.
+        if (!my_parent.my_super_offsets.empty()) {
+            search_nn_hierarchical(query);
+            return;
+        }
+
+        // Computing distances to all centers, which are then ordered in search_nn_clusters().
         {
             const auto query_san = sanitize_query(query);
             const auto ncenters = my_parent.my_sizes.size();
+            compute_center_distances(query_san, 0, ncenters, my_center_distances.data());
             my_center_order.clear();
-            my_center_order.reserve(ncenters);
-
             for (I<decltype(ncenters)> c = 0; c < ncenters; ++c) {
-                auto clust_ptr = my_parent.my_centers.data() + sanisizer::product_unsafe<std::size_t>(c, my_parent.my_dim);
-                my_center_order.emplace_back(my_parent.my_metric_center->raw(my_parent.my_dim, query_san, clust_ptr), c);
+                my_center_order.emplace_back(my_center_distances[c], c);
             }
-            std::sort(my_center_order.begin(), my_center_order.end());
         }
 
-        // Computing the distance to each center, and deciding whether to proceed for each cluster.
-        const auto& dist2centers = my_parent.my_dist_to_centroid;
-        Distance_ threshold_raw = std::numeric_limits<Distance_>::infinity();
+        search_nn_clusters(query);
+    }
 
-        for (const auto& curcent : my_center_order) {
-            const Index_ center = curcent.second;
-            Index_ firstsubj = my_parent.my_offsets[center], lastsubj = firstsubj + my_parent.my_sizes[center];
+    void search_nn_clusters(const Data_* query) {
+        prepare_quantized_query(query);
 
+        // The aim is to go through the nearest centers first, to try to get the shortest threshold (i.e., 'nearest.limit()') possible at the start;
+        // this allows us to skip searches of the later clusters. We use a min-heap to lazily order the centers in 'my_center_order',
+        // as we typically only need to visit a small number of the nearest centers before the rest of the centers are pruned.
+        const auto order_begin = my_center_order.begin();
+        auto order_end = my_center_order.end();
+        const std::greater<std::pair<Distance_, Index_> > comp;
+        std::make_heap(order_begin, order_end, comp);
+
+        Distance_ threshold_raw = std::numeric_limits<Distance_>::infinity();
+        std::size_t visited = 0;
+        while (order_begin != order_end && !reached_max_centers(visited)) {
+            std::pop_heap(order_begin, order_end, comp);
+            --order_end;
+            const auto& curcent = *order_end;
+
+            // All remaining centers are further from the query than the current center.
+            // So, if the current center's 'lower_bd' (see search_nn_cluster()) is greater than the largest radius of any cluster, we can skip all remaining clusters.
             if (!std::isinf(threshold_raw)) {
-                const Distance_ threshold = my_parent.my_metric_center->normalize(threshold_raw);
+                const Distance_ threshold = pruning_threshold(threshold_raw);
                 const Distance_ query2center = my_parent.my_metric_center->normalize(curcent.first);
-                const Distance_ max_subj2center = dist2centers[lastsubj - 1];
-
-                /* This exploits the triangle inequality to ignore points where:
-                 *     threshold + subject-to-center < query-to-center 
-                 * All points (if any) within this cluster with distances at or above 'lower_bd' are potentially countable.
-                 *
-                 * If the maximum distance between a subject and the center is less than 'lower_bd', there's no point proceeding,
-                 * as we know that all other subjects will have smaller distances and are thus uncountable.
-                 */
-                const Distance_ lower_bd = query2center - threshold;
-                if (max_subj2center < lower_bd) {
-                    continue;
+                if (my_max_radius < query2center - threshold) {
+                    count(my_counters.centers_skipped, order_end - order_begin + 1);
+                    break;
                 }
+            }
+
+            search_nn_cluster(query, curcent.second, curcent.first, threshold_raw);
+            ++visited;
+        }
+    }
+
+    // Searches the cluster for 'center', given the raw distance from the query to the center.
+    // 'threshold_raw' is the current (raw) distance threshold, which is shrunk as neighbors are added to 'my_nearest'.
+    void search_nn_cluster(const Data_* query, Index_ center, Distance_ query2center_raw, Distance_& threshold_raw) {
+        const auto& dist2centers = my_parent.my_dist_to_centroid;
+        Index_ firstsubj = my_parent.my_offsets[center], lastsubj = firstsubj + my_parent.my_sizes[center];
+        if (!std::isinf(threshold_raw)) {
+            const Distance_ threshold = pruning_threshold(threshold_raw);
+            const Distance_ query2center = my_parent.my_metric_center->normalize(query2center_raw);
+            const auto& radii = my_parent.my_cluster_radii[center];
+            const Distance_ min_subj2center = radii.first, max_subj2center = radii.second;
+
+            /* This exploits the triangle inequality to ignore points where:
+             *     threshold + subject-to-center < query-to-center 
+             * All points (if any) within this cluster with distances at or above 'lower_bd' are potentially countable.
+             *
+             * If the maximum distance between a subject and the center is less than 'lower_bd', there's no point proceeding,
+             * as we know that all other subjects will have smaller distances and are thus uncountable.
+             */
+            const Distance_ lower_bd = query2center - threshold;
+            if (max_subj2center < lower_bd) {
+                count(my_counters.centers_skipped);
+                return;
+            }
+
+            /* This exploits the reverse triangle inequality, to ignore points where:
+             *     threshold + query-to-center < subject-to-center
+             * All points (if any) within this cluster with distances at or below 'upper_bd' are potentially countable.
+             *
+             * If the minimum distance between a subject and the center is greater than 'upper_bd', we can skip the center altogether,
+             * i.e., the query lies well inside the hole of the annulus formed by the cluster's subjects.
+             */
+            const Distance_ upper_bd = query2center + threshold;
+            if (min_subj2center > upper_bd) {
+                count(my_counters.annulus_skipped);
+                return;
+            }
+
+            // The binary searches are only necessary if the bounds lie within the range of subject-to-center distances.
+            // If the minimum distance is already at or above 'lower_bd', all subjects are countable with respect to the lower bound, and so on.
+            if (min_subj2center < lower_bd) {
                 firstsubj = std::lower_bound(dist2centers.begin() + firstsubj, dist2centers.begin() + lastsubj, lower_bd) - dist2centers.begin();
+                count(my_counters.binary_search_trims);
+            }
+
+            // If the maximum distance between a subject and the center is less than or equal to 'upper_bd', we can just skip the search.
+            // No subjects will have a distance-to-center greater than 'upper_bd' so we know that we have to examine all subjects. 
+            if (max_subj2center > upper_bd) {
+                lastsubj = std::upper_bound(dist2centers.begin() + firstsubj, dist2centers.begin() + lastsubj, upper_bd) - dist2centers.begin();
+                count(my_counters.binary_search_trims);
+            }
+        }
+
+        scan_subjects(query, center, firstsubj, lastsubj, threshold_raw, [&](Index_ s, Distance_ dist2subj_raw) -> void {
+            if (dist2subj_raw <= threshold_raw) {
+                my_nearest.add(s, dist2subj_raw);
+                count(my_counters.queue_additions);
+                if (my_nearest.is_full()) {
+                    count(my_counters.threshold_tightenings, my_nearest.limit() < threshold_raw);
+                    threshold_raw = my_nearest.limit(); // Shrinking the threshold, if an earlier NN has been found.
+
+                    /* P.S. We could also consider increasing 'firstsubj' as 'threshold_raw' decreases. 
+                     * The idea would be to exploit the triangle inequality to quickly skip over more points. 
+                     * However, this is pointless because 'lower_bd' will never increase enough to skip subsequent observations.
+                     * We wouldn't have been able to skip the observation that we just added,
+                     * so there's no way we could skip observations with larger subject-to-center distances.
+                     *
+                     * P.P.S. We could also consider decreasing 'lastsubj' as 'threshold_raw' decreases.
+                     * The idea would be to exploit the triangle inequality to terminate sooner. 
+                     * However, this doesn't seem to provide a lot of benefit in practice. 
+                     * In theory, we can only trim the search space if the query already lies in a center's hypersphere (as 'upper_bd' cannot decrease below 'query2center').
+                     * Even then, 'upper_bd' is usually too large; testing indicates that a reduced 'upper_bd' only trims away a single observation at a time.
+                     * There are also practical challenges as changes to 'lastsubj' within the loop might prevent out-of-order CPU execution;
+                     * we need to do more memory accesses to 'dist2centers' to check if 'lastsubj' can be decreased;
+                     * and we need to run an extra 'normalize()' to recompute 'upper_bd' inside the loop.
+                     * All in all, I don't think it's worth it.
+                     */
+                }
+            }
+        });
+    }
+
+public:
+    // Used by KmknnPrebuilt::build_knn_graph() to find the nearest neighbors of the 'num' subjects at locations ['first', 'first' + 'num'), all of which belong to the same (i.e., host) center.
+    // Centers are visited in the order of 'host_order', which contains the normalized distances from the host center to each center in increasing order.
+    // 'max_radius' should be the largest distance from any subject to its center.
+    // The neighbors of the 'q'-th subject are stored in 'output_indices[q]' and 'output_distances[q]' as locations and raw distances, which should be converted by the caller.
+    void search_batch_from_host(
+        Index_ first,
+        Index_ num,
+        Index_ k,
+        const std::vector<std::pair<Distance_, Index_> >& host_order,
+        Distance_ max_radius,
+        std::vector<Index_>* output_indices,
+        std::vector<Distance_>* output_distances)
+    {
+        // Subjects of the same center are contiguous, so the query-to-center distances can be computed in blocks as in search_batch().
+        const auto ndim = my_parent.my_dim;
+        const auto ncenters = my_parent.my_sizes.size();
+        const auto queries = my_parent.my_data.data() + sanisizer::product_unsafe<std::size_t>(first, ndim);
+        compute_batch_center_distances(queries, num);
 
-                /* This exploits the reverse triangle inequality, to ignore points where:
-                 *     threshold + query-to-center < subject-to-center
-                 * All points (if any) within this cluster with distances at or below 'upper_bd' are potentially countable.
-                 *
-                 * If the maximum distance between a subject and the center is less than or equal to 'upper_bd', we can just skip the search.
-                 * No subjects will have a distance-to-center greater than 'upper_bd' so we know that we have to examine all subjects. 
-                 *
-                 * We could also skip this center altogther if the minimum subject-to-center distance is greater than 'upper_bd'.
-                 * However, this seems too unlikely to warrant a special clause.
-                 */
-                const Distance_ upper_bd = query2center + threshold;
-                if (max_subj2center > upper_bd) {
-                    lastsubj = std::upper_bound(dist2centers.begin() + firstsubj, dist2centers.begin() + lastsubj, upper_bd) - dist2centers.begin();
-                }
-            }
-
-            for (auto s = firstsubj; s < lastsubj; ++s) {
-                const auto other_subj = my_parent.my_data.data() + sanisizer::product_unsafe<std::size_t>(s, my_parent.my_dim);
-                auto dist2subj_raw = my_parent.my_metric_data->raw(my_parent.my_dim, query, other_subj);
-                if (dist2subj_raw <= threshold_raw) {
-                    my_nearest.add(s, dist2subj_raw);
-                    if (my_nearest.is_full()) {
-                        threshold_raw = my_nearest.limit(); // Shrinking the threshold, if an earlier NN has been found.
-
-                        /* P.S. We could also consider increasing 'firstsubj' as 'threshold_raw' decreases. 
-                         * The idea would be to exploit the triangle inequality to quickly skip over more points. 
-                         * However, this is pointless because 'lower_bd' will never increase enough to skip subsequent observations.
-                         * We wouldn't have been able to skip the observation that we just added,
-                         * so there's no way we could skip observations with larger subject-to-center distances.
-                         *
-                         * P.P.S. We could also consider decreasing 'lastsubj' as 'threshold_raw' decreases.
-                         * The idea would be to exploit the triangle inequality to terminate sooner. 
-                         * However, this doesn't seem to provide a lot of benefit in practice. 
-                         * In theory, we can only trim the search space if the query already lies in a center's hypersphere (as 'upper_bd' cannot decrease below 'query2center').
-                         * Even then, 'upper_bd' is usually too large; testing indicates that a reduced 'upper_bd' only trims away a single observation at a time.
-                         * There are also practical challenges as changes to 'lastsubj' within the loop might prevent out-of-order CPU execution;
-                         * we need to do more memory accesses to 'dist2centers' to check if 'lastsubj' can be decreased;
-                         * and we need to run an extra 'normalize()' to recompute 'upper_bd' inside the loop.
-                         * All in all, I don't think it's worth it.
-                         */
+        const auto& dist2centers = my_parent.my_dist_to_centroid;
+        for (Index_ q = 0; q < num; ++q) {
+            const Index_ loc = first + q;
+            const auto query = queries + sanisizer::product_unsafe<std::size_t>(q, ndim);
+            const auto query2centers_raw = my_batch_center_distances.data() + sanisizer::product_unsafe<std::size_t>(q, ncenters);
+            const bool deleted = my_parent.is_deleted(loc);
+            my_nearest.reset(deleted ? k : k + 1);
+            prepare_quantized_query(query);
+
+            const Distance_ query2host = dist2centers[loc];
+            Distance_ threshold_raw = std::numeric_limits<Distance_>::infinity();
+
+            for (const auto& curcent : host_order) {
+                const Index_ center = curcent.second;
+                if (!std::isinf(threshold_raw)) {
+                    /* By the triangle inequality, the query-to-center distance is no less than host-to-center minus query-to-host.
+                     * If this lower bound already satisfies the 'lower_bd' criterion in search_nn_cluster(), we can skip the cluster without scanning its subjects.
+                     * Moreover, as 'host_order' is sorted, we can stop altogether once the lower bound satisfies the criterion for the largest cluster radius.
+                     */
+                    const Distance_ threshold = my_parent.my_metric_center->normalize(threshold_raw);
+                    const Distance_ lower_bd = curcent.first - query2host - threshold;
+                    if (max_radius < lower_bd) {
+                        count(my_counters.centers_skipped, &(host_order.back()) - &curcent + 1);
+                        break;
+                    }
+                    if (my_parent.my_cluster_radii[center].second < lower_bd) {
+                        count(my_counters.centers_skipped);
+                        continue;
                     }
                 }
+
+                search_nn_cluster(query, center, query2centers_raw[center], threshold_raw);
+            }
+
+            if (deleted) {
+                my_nearest.report(output_indices + q, output_distances + q);
+            } else {
+                my_nearest.report(output_indices + q, output_distances + q, loc);
             }
         }
     }
 
-public:
     void search(Index_ i, Index_ k, std::vector<Index_>* output_indices, std::vector<Distance_>* output_distances) {
-        my_nearest.reset(k + 1); // +1 is safe as k < num_obs.
         auto new_i = my_parent.my_new_location[i];
         auto iptr = my_parent.my_data.data() + sanisizer::product_unsafe<std::size_t>(new_i, my_parent.my_dim);
+        if (my_parent.is_deleted(new_i)) {
+            // A deleted observation will never be reported as its own neighbor, so we treat it like any other query.
+            search_permuted(iptr, k, output_indices, output_distances);
+            return;
+        }
+
+        my_nearest.reset(k + 1); // +1 is safe as k < num_obs.
         search_nn(iptr);
         my_nearest.report(output_indices, output_distances, new_i);
         finalize(output_indices, output_distances);
     }
 
     void search(const Data_* query, Index_ k, std::vector<Index_>* output_indices, std::vector<Distance_>* output_distances) {
+        search_permuted(my_parent.permute_dimensions(query, 1, my_query_permutation_buffer), k, output_indices, output_distances);
+    }
+
+private:
+    // Same as search() for a query that has already been permuted to match the stored data.
+    void search_permuted(const Data_* query, Index_ k, std::vector<Index_>* output_indices, std::vector<Distance_>* output_distances) {
         if (k == 0) { // protect the NeighborQueue from k = 0.
             if (output_indices) {
                 output_indices->clear();
@@ -262,49 +934,200 @@ public:
         }
     }
 
+private:
+    // Number of queries and centers in each block of the batched query-to-center distance calculation.
+    // Each block of centers should fit comfortably in L1 for typical dimensionalities, while each block of queries should fit in L2.
+    static constexpr Index_ batch_query_block = 64;
+    // We use a multiple of the kernel block size so that each block of centers can be fully processed by the specialized distance kernels.
+    static constexpr std::size_t batch_center_block = kernel_block_size<Distance_>() * 2;
+
+    std::vector<Distance_> my_batch_center_distances;
+    typename std::conditional<needs_conversion, std::vector<KmeansFloat_>, bool>::type my_batch_conversion_buffer; 
+
+    void compute_batch_center_distances(const Data_* queries, Index_ num_queries) {
+        const auto ndim = my_parent.my_dim;
+        const auto ncenters = my_parent.my_sizes.size();
+
+        const KmeansFloat_* queries_san = NULL;
+        if constexpr(needs_conversion) {
+            my_batch_conversion_buffer.clear();
+            my_batch_conversion_buffer.insert(my_batch_conversion_buffer.end(), queries, queries + sanisizer::product_unsafe<std::size_t>(num_queries, ndim));
+            queries_san = my_batch_conversion_buffer.data();
+        } else {
+            queries_san = queries;
+        }
+
+        // Looping over the centers in the outer loop so that each block of centers stays in cache while we iterate over the queries.
+        my_batch_center_distances.resize(sanisizer::product<I<decltype(my_batch_center_distances.size())> >(sanisizer::attest_gez(num_queries), ncenters));
+        for (I<decltype(ncenters)> cstart = 0; cstart < ncenters; cstart += batch_center_block) {
+            const auto cend = cstart + std::min(batch_center_block, ncenters - cstart);
+            for (Index_ q = 0; q < num_queries; ++q) {
+                const auto qptr = queries_san + sanisizer::product_unsafe<std::size_t>(q, ndim);
+                const auto optr = my_batch_center_distances.data() + sanisizer::product_unsafe<std::size_t>(q, ncenters);
+                compute_center_distances(qptr, cstart, cend, optr + cstart);
+            }
+        }
+    }
+
+public:
+    /**
+     * Find the nearest neighbors for each of a batch of query observations.
+     * This is equivalent to calling `search()` on each query but is more efficient for large batches,
+     * as the query-to-center distances are computed in cache-friendly blocks.
+     *
+     * @param queries Pointer to a row-major array of query observations, where each row contains the coordinates for one query.
+     * @param num_queries Number of query observations.
+     * @param k Number of nearest neighbors to identify for each query.
+     * @param[out] output_indices Pointer to an array of length `num_queries`.
+     * On output, each vector contains the indices of the nearest neighbors for the corresponding query, as described for `search()`.
+     * Alternatively NULL, in which case the indices are not reported.
+     * @param[out] output_distances Pointer to an array of length `num_queries`.
+     * On output, each vector contains the distances to the nearest neighbors for the corresponding query, as described for `search()`.
+     * Alternatively NULL, in which case the distances are not reported.
+     */
+    void search_batch(const Data_* queries, Index_ num_queries, Index_ k, std::vector<Index_>* output_indices, std::vector<Distance_>* output_distances) {
+        const auto ndim = my_parent.my_dim;
+        const auto ncenters = my_parent.my_sizes.size();
+
+        // Advancing by the length of each block rather than by 'batch_query_block', so that 'qstart' never exceeds 'num_queries' and cannot overflow.
+        Index_ qstart = 0;
+        while (qstart < num_queries) {
+            const Index_ qlen = std::min(batch_query_block, static_cast<Index_>(num_queries - qstart));
+            const auto block_queries = my_parent.permute_dimensions(queries + sanisizer::product_unsafe<std::size_t>(qstart, ndim), qlen, my_query_permutation_buffer);
+            if (k) {
+                compute_batch_center_distances(block_queries, qlen);
+            }
+
+            for (Index_ q = 0; q < qlen; ++q) {
+                const auto curout = qstart + q;
+                auto cur_indices = (output_indices ? output_indices + curout : NULL);
+                auto cur_distances = (output_distances ? output_distances + curout : NULL);
+
+                if (k == 0) { // protect the NeighborQueue from k = 0.
+                    if (cur_indices) {
+                        cur_indices->clear();
+                    }
+                    if (cur_distances) {
+                        cur_distances->clear();
+                    }
+                    continue;
+                }
+
+                const auto dptr = my_batch_center_distances.data() + sanisizer::product_unsafe<std::size_t>(q, ncenters);
+                my_center_order.clear();
+                for (I<decltype(ncenters)> c = 0; c < ncenters; ++c) {
+                    my_center_order.emplace_back(dptr[c], c);
+                }
+
+                my_nearest.reset(k);
+                search_nn_clusters(block_queries + sanisizer::product_unsafe<std::size_t>(q, ndim));
+                my_nearest.report(cur_indices, cur_distances);
+                finalize(cur_indices, cur_distances);
+            }
+
+            qstart += qlen;
+        }
+    }
+
 private:
     template<bool count_only_, typename Output_>
     void search_all(const Data_* query, Distance_ threshold, Output_& all_neighbors) {
         Distance_ threshold_raw = my_parent.my_metric_center->denormalize(threshold);
         const auto query_san = sanitize_query(query);
+        prepare_quantized_query(query);
+
+        const auto& super_offsets = my_parent.my_super_offsets;
+        if (super_offsets.empty()) {
+            search_all_centers<count_only_>(query, query_san, 0, my_parent.my_sizes.size(), threshold, threshold_raw, all_neighbors);
+            return;
+        }
 
+        // Skipping entire super-centers using the same logic as in search_nn_cluster().
+        const auto& super_radius = my_parent.my_super_radius;
+        const auto nsuper = super_radius.size();
+        compute_super_distances(query_san);
+        for (I<decltype(nsuper)> g = 0; g < nsuper; ++g) {
+            const Distance_ query2super = my_parent.my_metric_center->normalize(my_super_distances[g]);
+            if (super_radius[g] < query2super - threshold) {
+                count(my_counters.centers_skipped, super_offsets[g + 1] - super_offsets[g]);
+                continue;
+            }
+            search_all_centers<count_only_>(query, query_san, super_offsets[g], super_offsets[g + 1], threshold, threshold_raw, all_neighbors);
+        }
+    }
+
+    template<bool count_only_, typename Output_>
+    void search_all_centers(
+        const Data_* query,
+        const KmeansFloat_* query_san,
+        std::size_t first_center,
+        std::size_t last_center,
+        Distance_ threshold,
+        Distance_ threshold_raw,
+        Output_& all_neighbors)
+    {
         // Computing distances to all centers. We don't sort them here because the threshold is constant so there's no point.
-        const auto ncenters = my_parent.my_sizes.size();
         const auto& dist2centers = my_parent.my_dist_to_centroid;
+        compute_center_distances(query_san, first_center, last_center, my_center_distances.data() + first_center);
 
-        for (I<decltype(ncenters)> center = 0; center < ncenters; ++center) {
-            auto center_ptr = my_parent.my_centers.data() + sanisizer::product_unsafe<std::size_t>(center, my_parent.my_dim);
-            const Distance_ query2center = my_parent.my_metric_center->normalize(my_parent.my_metric_center->raw(my_parent.my_dim, query_san, center_ptr));
+        for (auto center = first_center; center < last_center; ++center) {
+            const Distance_ query2center = my_parent.my_metric_center->normalize(my_center_distances[center]);
             Index_ firstsubj = my_parent.my_offsets[center], lastsubj = firstsubj + my_parent.my_sizes[center];
-            const Distance_ max_subj2center = dist2centers[lastsubj - 1];
+            const auto& radii = my_parent.my_cluster_radii[center];
+            const Distance_ min_subj2center = radii.first, max_subj2center = radii.second;
 
-            // Same logic as in search_nn().
+            // Same logic as in search_nn_cluster().
             const Distance_ lower_bd = query2center - threshold;
             if (max_subj2center < lower_bd) {
+                count(my_counters.centers_skipped);
                 continue;
             }
-            firstsubj = std::lower_bound(dist2centers.begin() + firstsubj, dist2centers.begin() + lastsubj, lower_bd) - dist2centers.begin();
-
-            // Same logic as in search_nn().
             const Distance_ upper_bd = query2center + threshold;
+            if (min_subj2center > upper_bd) {
+                count(my_counters.annulus_skipped);
+                continue;
+            }
+
+            if (min_subj2center < lower_bd) {
+                firstsubj = std::lower_bound(dist2centers.begin() + firstsubj, dist2centers.begin() + lastsubj, lower_bd) - dist2centers.begin();
+                count(my_counters.binary_search_trims);
+            }
             if (max_subj2center > upper_bd) {
                 lastsubj = std::upper_bound(dist2centers.begin() + firstsubj, dist2centers.begin() + lastsubj, upper_bd) - dist2centers.begin();
+                count(my_counters.binary_search_trims);
             }
 
-            for (auto s = firstsubj; s < lastsubj; ++s) {
-                const auto other_ptr = my_parent.my_data.data() + sanisizer::product_unsafe<std::size_t>(s, my_parent.my_dim);
-                auto dist2cell_raw = my_parent.my_metric_data->raw(my_parent.my_dim, query, other_ptr);
+            scan_subjects(query, center, firstsubj, lastsubj, threshold_raw, [&](Index_ s, Distance_ dist2cell_raw) -> void {
                 if (dist2cell_raw <= threshold_raw) {
+                    count(my_counters.queue_additions);
                     if constexpr(count_only_) {
                         ++all_neighbors;
                     } else {
                         all_neighbors.emplace_back(dist2cell_raw, s);
                     }
                 }
-            }
+            });
         }
     }
 
+    friend class KmknnPrebuilt<Index_, Data_, Distance_, DistanceMetricData_, KmeansFloat_, DistanceMetricCenter_>;
+
+public:
+    /**
+     * @return Counters for the work performed by this searcher since its construction or the last call to `reset_counters()`.
+     * All counters are zero if `search_counters_enabled` is false.
+     */
+    const KmknnSearchCounters& get_counters() const {
+        return my_counters;
+    }
+
+    /**
+     * Reset all counters to zero.
+     */
+    void reset_counters() {
+        my_counters = KmknnSearchCounters();
+    }
+
 public:
     bool can_search_all() const {
         return true;
@@ -313,6 +1136,9 @@ public:
     Index_ search_all(Index_ i, Distance_ d, std::vector<Index_>* output_indices, std::vector<Distance_>* output_distances) {
         auto new_i = my_parent.my_new_location[i];
         auto iptr = my_parent.my_data.data() + sanisizer::product_unsafe<std::size_t>(new_i, my_parent.my_dim);
+        if (my_parent.is_deleted(new_i)) {
+            return search_all_permuted(iptr, d, output_indices, output_distances);
+        }
 
         if (!output_indices && !output_distances) {
             Index_ count = 0;
@@ -329,6 +1155,12 @@ public:
     }
 
     Index_ search_all(const Data_* query, Distance_ d, std::vector<Index_>* output_indices, std::vector<Distance_>* output_distances) {
+        return search_all_permuted(my_parent.permute_dimensions(query, 1, my_query_permutation_buffer), d, output_indices, output_distances);
+    }
+
+private:
+    // Same as search_all() for a query that has already been permuted to match the stored data.
+    Index_ search_all_permuted(const Data_* query, Distance_ d, std::vector<Index_>* output_indices, std::vector<Distance_>* output_distances) {
         if (!output_indices && !output_distances) {
             Index_ count = 0;
             search_all<true>(query, d, count);
@@ -345,7 +1177,7 @@ public:
 };
 
 template<typename Index_, typename Data_, typename Distance_, class DistanceMetricData_, typename KmeansFloat_, class DistanceMetricCenter_>
-class KmknnPrebuilt final : public knncolle::Prebuilt<Index_, Data_, Distance_> {
+class KmknnPrebuilt final : public knncolle::Prebuilt<Index_, Data_, Distance_>, public ContainerSaveable {
 private:
     std::size_t my_dim;
     Index_ my_obs;
@@ -360,17 +1192,478 @@ public:
     }
 
 private:
-    std::vector<Data_> my_data;
+    ArrayStore<Data_> my_data;
     std::shared_ptr<const DistanceMetricData_> my_metric_data;
     std::shared_ptr<const DistanceMetricCenter_> my_metric_center;
     
-    std::vector<Index_> my_sizes;
-    std::vector<Index_> my_offsets;
+    ArrayStore<Index_> my_sizes;
+    ArrayStore<Index_> my_offsets;
+
+    ArrayStore<KmeansFloat_> my_centers;
+
+    ArrayStore<Index_> my_observation_id, my_new_location;
+    ArrayStore<Distance_> my_dist_to_centroid;
+
+    // Whether we can use the specialized kernels for the stock distance metrics.
+    DistanceKind my_data_kind = DistanceKind::OTHER;
+    DistanceKind my_center_kind = DistanceKind::OTHER;
+
+    std::size_t my_early_abandon_block = 0;
+
+    // Power of the number of observations used to define the number of centers, either from KmknnOptions::power or from tuning.
+    double my_power = 0.5;
+
+    // Build settings that cannot be recovered from the other members, e.g., if the index has no observations.
+    // These are used to rebuild the index with the same settings in the default add().
+    bool my_quantize = false;
+    bool my_reorder_dimensions = false;
+    double my_super_center_power = 0;
+    Index_ my_max_cluster_size = 0;
+
+    // Scalar quantization of the data, for filtering candidates.
+    // The maximum quantization error is stored as a normalized distance.
+    ArrayStore<unsigned char> my_quantized;
+    std::vector<Distance_> my_quantized_min, my_quantized_scale;
+    Distance_ my_quantized_error = 0;
+    Distance_ my_quantized_tolerance = 0;
+
+    // Optional pivots for each cluster, see KmknnOptions::num_pivots.
+    // The coordinates of the 'p'-th pivot of cluster 'c' start at 'my_pivots[(c * my_num_pivots + p) * my_dim]',
+    // while the normalized distance from the subject at location 's' to the 'p'-th pivot of its cluster is stored at 'my_pivot_distances[s * my_num_pivots + p]'.
+    std::size_t my_num_pivots = 0;
+    std::vector<Data_> my_pivots;
+    ArrayStore<Distance_> my_pivot_distances;
+    Distance_ my_pivot_tolerance = 0;
+
+    void set_pivot_tolerance() {
+        // Allowing for some round-off error in the query-to-pivot and subject-to-pivot distances.
+        my_pivot_tolerance = std::numeric_limits<Distance_>::epsilon() * 4 * static_cast<Distance_>(my_dim + 2);
+    }
 
-    std::vector<KmeansFloat_> my_centers;
+    void compute_pivots(int num_threads) {
+        const auto ncenters = my_sizes.size();
+        const auto num_pivots = my_num_pivots;
+        my_pivots.resize(sanisizer::product<I<decltype(my_pivots.size())> >(sanisizer::product<std::size_t>(ncenters, num_pivots), my_dim));
+        auto pivot_distances = sanisizer::create<std::vector<Distance_> >(sanisizer::product<std::size_t>(sanisizer::attest_gez(my_obs), num_pivots));
+
+        const auto& data = my_data; // const reference to avoid materializing a memory-mapped array.
+        knncolle::parallelize(num_threads, ncenters, [&](int, std::size_t start, std::size_t length) -> void {
+            std::vector<Distance_> buffer, min_distances;
+            for (std::size_t c = start, end = start + length; c < end; ++c) {
+                const Index_ first = my_offsets[c], size = my_sizes[c];
+                if (size == 0) {
+                    continue;
+                }
+                const auto subjects = data.data() + sanisizer::product_unsafe<std::size_t>(first, my_dim);
+                buffer.resize(size);
+                min_distances.clear();
+                min_distances.resize(size, std::numeric_limits<Distance_>::infinity());
+
+                // The subjects are sorted by their distance to the center, so the last subject is the farthest.
+                Index_ chosen = size - 1;
+                for (std::size_t p = 0; p < num_pivots; ++p) {
+                    const auto pivot = my_pivots.data() + sanisizer::product_unsafe<std::size_t>(c * num_pivots + p, my_dim);
+                    std::copy_n(subjects + sanisizer::product_unsafe<std::size_t>(chosen, my_dim), my_dim, pivot);
+                    compute_raw_distances(my_data_kind, *my_metric_data, my_dim, pivot, subjects, size, buffer.data());
+                    for (Index_ s = 0; s < size; ++s) {
+                        const auto dist = my_metric_data->normalize(buffer[s]);
+                        pivot_distances[sanisizer::product_unsafe<std::size_t>(first + s, num_pivots) + p] = dist;
+                        min_distances[s] = std::min(min_distances[s], dist);
+                    }
+                    chosen = std::max_element(min_distances.begin(), min_distances.end()) - min_distances.begin();
+                }
+            }
+        });
+
+        my_pivot_distances = ArrayStore<Distance_>(std::move(pivot_distances));
+        set_pivot_tolerance();
+    }
+
+    // Optional transposed copy of the data, see KmknnOptions::tile_subjects.
+    // Each cluster's subjects are split into tiles of 'kernel_block_size()' subjects, where the first tile of cluster 'c' is 'my_tile_offsets[c]'.
+    // Within each tile, the 'd'-th dimension of the 'b'-th subject is stored at 'd * block + b', and the start of each tile is 'my_tile_stride' elements apart.
+    // Trailing lanes of the last tile in each cluster are filled with zeros and their distances are ignored.
+    bool my_tiled = false;
+    std::vector<Data_, AlignedAllocator<Data_> > my_tiles;
+    std::vector<std::size_t> my_tile_offsets;
+    std::size_t my_tile_stride = 0;
+
+    void compute_tiles(int num_threads) {
+        constexpr std::size_t block = kernel_block_size<Distance_>();
+        const auto ncenters = my_sizes.size();
+        sanisizer::resize(my_tile_offsets, ncenters);
+        std::size_t num_tiles = 0;
+        for (I<decltype(ncenters)> c = 0; c < ncenters; ++c) {
+            my_tile_offsets[c] = num_tiles;
+            num_tiles = sanisizer::sum<std::size_t>(num_tiles, my_sizes[c] / block + (my_sizes[c] % block > 0));
+        }
 
-    std::vector<Index_> my_observation_id, my_new_location;
-    std::vector<Distance_> my_dist_to_centroid;
+        my_tile_stride = tile_stride<Data_, Distance_>(my_dim);
+        my_tiles.clear();
+        my_tiles.resize(sanisizer::product<I<decltype(my_tiles.size())> >(num_tiles, my_tile_stride));
+
+        const auto& data = my_data; // const reference to avoid materializing a memory-mapped array.
+        knncolle::parallelize(num_threads, ncenters, [&](int, std::size_t start, std::size_t length) -> void {
+            for (std::size_t c = start, end = start + length; c < end; ++c) {
+                const Index_ first = my_offsets[c], size = my_sizes[c];
+                for (Index_ s = 0; s < size; ++s) {
+                    const auto subject = data.data() + sanisizer::product_unsafe<std::size_t>(first + s, my_dim);
+                    const auto tile = my_tiles.data() + sanisizer::product_unsafe<std::size_t>(my_tile_offsets[c] + s / block, my_tile_stride);
+                    const std::size_t lane = s % block;
+                    for (std::size_t d = 0; d < my_dim; ++d) {
+                        tile[d * block + lane] = subject[d];
+                    }
+                }
+            }
+        });
+    }
+
+    // Order of the dimensions in the stored data, centers and queries, where the d-th stored dimension is the 'my_dimension_order[d]'-th dimension of the original data.
+    // This is left empty if the dimensions were not reordered.
+    std::vector<std::size_t> my_dimension_order;
+
+    // Tombstones for deleted observations, indexed by their location in the reordered data.
+    // This is left empty if no observations were deleted so that the search doesn't need to check it.
+    std::vector<unsigned char> my_deleted;
+    Index_ my_num_deleted = 0;
+
+    // Minimum and maximum distance from the center of each cluster to its subjects, for fast pruning without accessing 'my_dist_to_centroid'.
+    // These are derived from the sorted distances in 'my_dist_to_centroid' and are not saved.
+    std::vector<std::pair<Distance_, Distance_> > my_cluster_radii;
+
+    void compute_cluster_radii() {
+        const auto ncenters = my_sizes.size();
+        my_cluster_radii.resize(ncenters);
+        const auto& offsets = my_offsets;
+        const auto& sizes = my_sizes;
+        const auto& dist2centers = my_dist_to_centroid; // const references to avoid materializing any memory-mapped arrays.
+        for (I<decltype(ncenters)> c = 0; c < ncenters; ++c) {
+            const auto first = offsets[c];
+            my_cluster_radii[c].first = dist2centers[first];
+            my_cluster_radii[c].second = dist2centers[first + sizes[c] - 1];
+        }
+    }
+
+    // Optional super-centers, each of which is associated with a contiguous range of centers [my_super_offsets[g], my_super_offsets[g + 1]).
+    // The radius of each super-center is the largest (normalized) distance from the super-center to any subject in its centers' clusters.
+    std::vector<KmeansFloat_> my_super_centers;
+    std::vector<std::size_t> my_super_offsets;
+    std::vector<Distance_> my_super_radius;
+
+    // Clusters the centers into super-centers, permuting the centers so that those assigned to the same super-center are contiguous.
+    // 'clusters' and 'sizes' are updated to reflect the new ordering of centers.
+    template<typename KmeansIndex_, typename KmeansCluster_, class Sizes_>
+    void cluster_centers(KmeansCluster_ ncenters, std::vector<KmeansCluster_>& clusters, Sizes_& sizes, double power, int num_threads) {
+        KmeansCluster_ nsuper = sanisizer::from_float<KmeansCluster_>(std::ceil(std::pow(ncenters, power)));
+        nsuper = std::min(nsuper, ncenters);
+        if (nsuper == 0) {
+            return;
+        }
+
+        typedef kmeans::SimpleMatrix<KmeansIndex_, KmeansFloat_> CenterMatrix;
+        CenterMatrix cmat(my_dim, sanisizer::cast<KmeansIndex_>(ncenters), my_centers.data());
+        kmeans::InitializeKmeansppOptions iopt;
+        iopt.num_threads = num_threads;
+        kmeans::InitializeKmeanspp<KmeansIndex_, KmeansFloat_, KmeansCluster_, KmeansFloat_, CenterMatrix> init(iopt);
+        kmeans::RefineHartiganWongOptions ropt;
+        ropt.num_threads = num_threads;
+        kmeans::RefineHartiganWong<KmeansIndex_, KmeansFloat_, KmeansCluster_, KmeansFloat_, CenterMatrix> refine(ropt);
+
+        my_super_centers.resize(sanisizer::product<I<decltype(my_super_centers.size())> >(nsuper, my_dim));
+        auto assignments = sanisizer::create<std::vector<KmeansCluster_> >(ncenters);
+        auto output = kmeans::compute(cmat, init, refine, nsuper, my_super_centers.data(), assignments.data());
+        nsuper = kmeans::remove_unused_centers(my_dim, static_cast<KmeansIndex_>(ncenters), assignments.data(), nsuper, my_super_centers.data(), output.sizes);
+        my_super_centers.resize(sanisizer::product_unsafe<I<decltype(my_super_centers.size())> >(nsuper, my_dim));
+
+        sanisizer::resize(my_super_offsets, sanisizer::sum<std::size_t>(nsuper, 1));
+        for (auto a : assignments) {
+            ++my_super_offsets[a + 1];
+        }
+        for (KmeansCluster_ g = 0; g < nsuper; ++g) {
+            my_super_offsets[g + 1] += my_super_offsets[g];
+        }
+
+        // Permuting the centers so that each super-center's centers are contiguous, preserving the original order within each super-center.
+        std::vector<KmeansCluster_> new_index(ncenters);
+        {
+            std::vector<std::size_t> sofar(my_super_offsets.begin(), my_super_offsets.end() - 1);
+            for (KmeansCluster_ c = 0; c < ncenters; ++c) {
+                new_index[c] = sofar[assignments[c]]++;
+            }
+        }
+
+        auto permuted_centers = sanisizer::create<std::vector<KmeansFloat_> >(my_centers.size());
+        Sizes_ permuted_sizes(sizes.size());
+        for (KmeansCluster_ c = 0; c < ncenters; ++c) {
+            const auto dest = new_index[c];
+            std::copy_n(my_centers.data() + sanisizer::product_unsafe<std::size_t>(c, my_dim), my_dim, permuted_centers.data() + sanisizer::product_unsafe<std::size_t>(dest, my_dim));
+            permuted_sizes[dest] = sizes[c];
+        }
+        my_centers.swap(permuted_centers);
+        sizes.swap(permuted_sizes);
+        for (auto& c : clusters) {
+            c = new_index[c];
+        }
+    }
+
+    // Splits clusters with more than 'max_size' observations by k-means clustering of their observations, repeating until all clusters are small enough.
+    // The first subcluster of each split cluster retains the original cluster's index while the others are appended to the end.
+    template<typename KmeansIndex_, typename KmeansData_, typename KmeansCluster_, class Sizes_>
+    void split_large_clusters(KmeansCluster_& ncenters, std::vector<KmeansCluster_>& clusters, Sizes_& sizes, Index_ max_size, int num_threads) {
+        typedef kmeans::SimpleMatrix<KmeansIndex_, KmeansData_> SubsetMatrix;
+        kmeans::InitializeKmeansppOptions iopt;
+        iopt.num_threads = num_threads;
+        kmeans::InitializeKmeanspp<KmeansIndex_, KmeansData_, KmeansCluster_, KmeansFloat_, SubsetMatrix> init(iopt);
+        kmeans::RefineHartiganWongOptions ropt;
+        ropt.num_threads = num_threads;
+        kmeans::RefineHartiganWong<KmeansIndex_, KmeansData_, KmeansCluster_, KmeansFloat_, SubsetMatrix> refine(ropt);
+
+        const std::size_t cap = max_size;
+        std::vector<std::vector<Index_> > members;
+        std::vector<KmeansData_> subset;
+        std::vector<KmeansFloat_> subcenters;
+        std::vector<KmeansCluster_> subclusters;
+
+        while (true) {
+            members.clear();
+            members.resize(ncenters);
+            bool oversized = false;
+            for (Index_ o = 0; o < my_obs; ++o) {
+                const auto c = clusters[o];
+                if (static_cast<std::size_t>(sizes[c]) > cap) {
+                    members[c].push_back(o);
+                    oversized = true;
+                }
+            }
+            if (!oversized) {
+                break;
+            }
+
+            const KmeansCluster_ old_ncenters = ncenters;
+            for (KmeansCluster_ c = 0; c < old_ncenters; ++c) {
+                const auto& current = members[c];
+                if (current.empty()) {
+                    continue;
+                }
+
+                const auto nmembers = current.size();
+                subset.resize(sanisizer::product<I<decltype(subset.size())> >(nmembers, my_dim));
+                for (I<decltype(nmembers)> m = 0; m < nmembers; ++m) {
+                    auto src = my_data.data() + sanisizer::product_unsafe<std::size_t>(current[m], my_dim);
+                    std::copy_n(src, my_dim, subset.data() + sanisizer::product_unsafe<std::size_t>(m, my_dim));
+                }
+
+                KmeansCluster_ nsplit = sanisizer::cast<KmeansCluster_>((nmembers - 1) / cap + 1);
+                SubsetMatrix smat(my_dim, sanisizer::cast<KmeansIndex_>(nmembers), subset.data());
+                subcenters.resize(sanisizer::product<I<decltype(subcenters.size())> >(nsplit, my_dim));
+                subclusters.resize(nmembers);
+                auto details = kmeans::compute(smat, init, refine, nsplit, subcenters.data(), subclusters.data());
+                const auto survivors = kmeans::remove_unused_centers(my_dim, static_cast<KmeansIndex_>(nmembers), subclusters.data(), nsplit, subcenters.data(), details.sizes);
+
+                if (survivors < 2) {
+                    // k-means cannot split the cluster, e.g., because all of its observations are identical.
+                    // In such cases, we just split it into consecutive chunks that all use the original center.
+                    // This is still valid as the search does not require each observation to be assigned to its closest center.
+                    details.sizes.clear();
+                    details.sizes.resize(nsplit);
+                    for (I<decltype(nmembers)> m = 0; m < nmembers; ++m) {
+                        subclusters[m] = m / cap;
+                        ++details.sizes[subclusters[m]];
+                    }
+                    for (KmeansCluster_ s = 0; s < nsplit; ++s) {
+                        std::copy_n(my_centers.data() + sanisizer::product_unsafe<std::size_t>(c, my_dim), my_dim, subcenters.data() + sanisizer::product_unsafe<std::size_t>(s, my_dim));
+                    }
+                } else {
+                    nsplit = survivors;
+                }
+
+                const KmeansCluster_ first_new = ncenters;
+                ncenters = sanisizer::sum<KmeansCluster_>(ncenters, nsplit - 1);
+                my_centers.resize(sanisizer::product<I<decltype(my_centers.size())> >(ncenters, my_dim));
+                sizes.resize(ncenters);
+                for (KmeansCluster_ s = 0; s < nsplit; ++s) {
+                    const KmeansCluster_ dest = (s == 0 ? c : first_new + s - 1);
+                    std::copy_n(subcenters.data() + sanisizer::product_unsafe<std::size_t>(s, my_dim), my_dim, my_centers.data() + sanisizer::product_unsafe<std::size_t>(dest, my_dim));
+                    sizes[dest] = details.sizes[s];
+                }
+                for (I<decltype(nmembers)> m = 0; m < nmembers; ++m) {
+                    const auto s = subclusters[m];
+                    clusters[current[m]] = (s == 0 ? c : first_new + s - 1);
+                }
+            }
+        }
+    }
+
+    void compute_super_radii() {
+        const auto nsuper = sanisizer::cast<std::size_t>(my_super_offsets.size()) - 1;
+        my_super_radius.clear();
+        my_super_radius.resize(nsuper);
+        std::vector<Distance_> center_distances;
+        for (std::size_t g = 0; g < nsuper; ++g) {
+            const auto first = my_super_offsets[g], last = my_super_offsets[g + 1];
+            center_distances.resize(last - first);
+            compute_raw_distances(
+                my_center_kind,
+                *my_metric_center,
+                my_dim,
+                my_super_centers.data() + sanisizer::product_unsafe<std::size_t>(g, my_dim),
+                my_centers.data() + sanisizer::product_unsafe<std::size_t>(first, my_dim),
+                last - first,
+                center_distances.data()
+            );
+
+            // By the triangle inequality, the distance from the super-center to a subject is no greater than the super-center-to-center plus the subject-to-center distances.
+            auto& radius = my_super_radius[g];
+            for (auto c = first; c < last; ++c) {
+                const Distance_ center_radius = my_cluster_radii[c].second;
+                radius = std::max(radius, my_metric_center->normalize(center_distances[c - first]) + center_radius);
+            }
+        }
+    }
+
+    // Largest distance from any subject to its center.
+    Distance_ max_radius() const {
+        Distance_ output = 0;
+        const auto ncenters = my_sizes.size();
+        for (I<decltype(ncenters)> c = 0; c < ncenters; ++c) {
+            output = std::max(output, my_cluster_radii[c].second);
+        }
+        return output;
+    }
+
+    bool is_deleted(Index_ location) const {
+        return !my_deleted.empty() && my_deleted[location];
+    }
+
+    void set_quantized_tolerance() {
+        // Allowing for some round-off error when comparing quantized distances to the threshold.
+        my_quantized_tolerance = std::numeric_limits<Distance_>::epsilon() * 4 * static_cast<Distance_>(my_dim + 2);
+    }
+
+    void quantize(int num_threads) {
+        if (my_data_kind == DistanceKind::OTHER || my_obs == 0 || my_dim == 0) {
+            return;
+        }
+
+        std::vector<Data_> mins(my_data.begin(), my_data.begin() + my_dim), maxs = mins;
+        for (Index_ o = 1; o < my_obs; ++o) {
+            auto optr = my_data.data() + sanisizer::product_unsafe<std::size_t>(o, my_dim);
+            for (std::size_t d = 0; d < my_dim; ++d) {
+                mins[d] = std::min(mins[d], optr[d]);
+                maxs[d] = std::max(maxs[d], optr[d]);
+            }
+        }
+
+        sanisizer::resize(my_quantized_min, my_dim);
+        sanisizer::resize(my_quantized_scale, my_dim);
+        constexpr unsigned char max_code = std::numeric_limits<unsigned char>::max();
+        for (std::size_t d = 0; d < my_dim; ++d) {
+            my_quantized_min[d] = mins[d];
+            my_quantized_scale[d] = (static_cast<Distance_>(maxs[d]) - my_quantized_min[d]) / max_code;
+        }
+
+        // Recording the maximum error in each dimension, computed in the same manner as the search.
+        // This ensures that the bound accounts for any imprecision in the quantization itself.
+        my_quantized.resize(my_data.size());
+        const int nworkers = std::max(1, num_threads);
+        std::vector<std::vector<Distance_> > errors(nworkers, std::vector<Distance_>(my_dim));
+        knncolle::parallelize(nworkers, my_obs, [&](int t, Index_ start, Index_ length) -> void {
+            auto& curerrors = errors[t];
+            for (Index_ o = start, end = start + length; o < end; ++o) {
+                const auto offset = sanisizer::product_unsafe<std::size_t>(o, my_dim);
+                auto optr = my_data.data() + offset;
+                auto qptr = my_quantized.data() + offset;
+                for (std::size_t d = 0; d < my_dim; ++d) {
+                    const Distance_ shifted = static_cast<Distance_>(optr[d]) - my_quantized_min[d];
+                    const auto scale = my_quantized_scale[d];
+                    unsigned char code = 0;
+                    if (scale > 0) {
+                        code = static_cast<unsigned char>(std::min<Distance_>(max_code, std::max<Distance_>(0, std::round(shifted / scale))));
+                    }
+                    qptr[d] = code;
+                    curerrors[d] = std::max(curerrors[d], std::abs(shifted - static_cast<Distance_>(code) * scale));
+                }
+            }
+        });
+
+        Distance_ total = 0;
+        for (std::size_t d = 0; d < my_dim; ++d) {
+            Distance_ maxerr = 0;
+            for (const auto& curerrors : errors) {
+                maxerr = std::max(maxerr, curerrors[d]);
+            }
+            total += (my_data_kind == DistanceKind::EUCLIDEAN ? maxerr * maxerr : maxerr);
+        }
+        my_quantized_error = my_metric_data->normalize(total);
+        set_quantized_tolerance();
+    }
+
+    void identify_distances() {
+        my_data_kind = identify_distance<Data_, Distance_>(my_metric_data.get());
+        my_center_kind = identify_distance<KmeansFloat_, Distance_>(my_metric_center.get());
+    }
+
+    // Permutes the dimensions of the data in order of decreasing variance, see KmknnOptions::reorder_dimensions.
+    void reorder_dimensions(int num_threads) {
+        if (my_data_kind == DistanceKind::OTHER || my_center_kind == DistanceKind::OTHER || my_obs < 2 || my_dim < 2) {
+            return;
+        }
+
+        std::vector<Distance_> means(my_dim), variances(my_dim);
+        for (Index_ o = 0; o < my_obs; ++o) {
+            auto optr = my_data.data() + sanisizer::product_unsafe<std::size_t>(o, my_dim);
+            for (std::size_t d = 0; d < my_dim; ++d) {
+                means[d] += optr[d];
+            }
+        }
+        for (auto& m : means) {
+            m /= my_obs;
+        }
+        for (Index_ o = 0; o < my_obs; ++o) {
+            auto optr = my_data.data() + sanisizer::product_unsafe<std::size_t>(o, my_dim);
+            for (std::size_t d = 0; d < my_dim; ++d) {
+                const Distance_ delta = static_cast<Distance_>(optr[d]) - means[d];
+                variances[d] += delta * delta;
+            }
+        }
+
+        std::vector<std::size_t> order(my_dim);
+        std::iota(order.begin(), order.end(), static_cast<std::size_t>(0));
+        std::stable_sort(order.begin(), order.end(), [&](std::size_t left, std::size_t right) -> bool {
+            return variances[left] > variances[right];
+        });
+        if (std::is_sorted(order.begin(), order.end())) {
+            return;
+        }
+
+        knncolle::parallelize(num_threads, my_obs, [&](int, Index_ start, Index_ length) -> void {
+            std::vector<Data_> buffer(my_dim);
+            for (Index_ o = start, end = start + length; o < end; ++o) {
+                auto optr = my_data.data() + sanisizer::product_unsafe<std::size_t>(o, my_dim);
+                for (std::size_t d = 0; d < my_dim; ++d) {
+                    buffer[d] = optr[order[d]];
+                }
+                std::copy(buffer.begin(), buffer.end(), optr);
+            }
+        });
+        my_dimension_order.swap(order);
+    }
+
+    // Copies 'num' observations from 'input' into 'output', permuting their dimensions to match the stored data.
+    // If the dimensions were not reordered, 'input' is returned directly.
+    const Data_* permute_dimensions(const Data_* input, std::size_t num, std::vector<Data_>& output) const {
+        if (my_dimension_order.empty()) {
+            return input;
+        }
+        output.resize(sanisizer::product<I<decltype(output.size())> >(num, my_dim));
+        for (std::size_t o = 0; o < num; ++o) {
+            const auto offset = sanisizer::product_unsafe<std::size_t>(o, my_dim);
+            for (std::size_t d = 0; d < my_dim; ++d) {
+                output[offset + d] = input[offset + my_dimension_order[d]];
+            }
+        }
+        return output.data();
+    }
 
 public:
     template<typename KmeansIndex_, typename KmeansData_, typename KmeansCluster_, class KmeansMatrix_>
@@ -388,44 +1681,395 @@ public:
         my_metric_data(std::move(metric_data)),
         my_metric_center(std::move(metric_center))
     { 
+        identify_distances();
+        my_early_abandon_block = options.early_abandon_block;
+
+        auto init = options.initialize_algorithm;
+        if (init == nullptr) {
+            kmeans::InitializeKmeansppOptions iopt;
+            iopt.num_threads = options.num_threads;
+            init.reset(new kmeans::InitializeKmeanspp<KmeansIndex_, KmeansData_, KmeansCluster_, KmeansFloat_, KmeansMatrix_>(iopt));
+        }
+        auto refine = options.refine_algorithm;
+        if (refine == nullptr) {
+            kmeans::RefineHartiganWongOptions ropt;
+            ropt.num_threads = options.num_threads;
+            refine.reset(new kmeans::RefineHartiganWong<KmeansIndex_, KmeansData_, KmeansCluster_, KmeansFloat_, KmeansMatrix_>(ropt));
+        }
+
+        my_quantize = options.quantize;
+        my_reorder_dimensions = options.reorder_dimensions;
+        my_super_center_power = options.super_center_power;
+        my_max_cluster_size = options.max_cluster_size;
+
+        if (options.reorder_dimensions) {
+            reorder_dimensions(options.num_threads);
+        }
+
+        my_power = (options.candidate_powers.empty() ? options.power : tune_power(options));
+        KmeansCluster_ ncenters = sanisizer::from_float<KmeansCluster_>(std::ceil(std::pow(my_obs, my_power)));
+        my_centers.resize(sanisizer::product<I<decltype(my_centers.size())> >(sanisizer::attest_gez(ncenters), my_dim));
+
+        auto clusters = sanisizer::create<std::vector<KmeansCluster_> >(sanisizer::attest_gez(my_obs));
+        kmeans::Details<KmeansIndex_> output;
+
+        // Subsampling requires at least one observation per center, otherwise we might as well use all observations.
+        Index_ num_subsample = options.kmeans_subsample_size;
+        if (num_subsample > 0 && static_cast<std::size_t>(num_subsample) < static_cast<std::size_t>(ncenters)) {
+            num_subsample = (static_cast<std::size_t>(ncenters) < static_cast<std::size_t>(my_obs) ? static_cast<Index_>(ncenters) : my_obs);
+        }
+
+        if (num_subsample > 0 && num_subsample < my_obs) {
+            // Fitting the centers on a random subsample, followed by a single assignment pass over all observations.
+            const auto chosen = choose_subsample(num_subsample, options.kmeans_subsample_seed);
+            auto subsample = sanisizer::create<std::vector<KmeansData_> >(sanisizer::product<std::size_t>(num_subsample, my_dim));
+            for (Index_ s = 0; s < num_subsample; ++s) {
+                auto src = my_data.data() + sanisizer::product_unsafe<std::size_t>(chosen[s], my_dim);
+                std::copy_n(src, my_dim, subsample.data() + sanisizer::product_unsafe<std::size_t>(s, my_dim));
+            }
+
+            kmeans::SimpleMatrix<KmeansIndex_, KmeansData_> submat(my_dim, sanisizer::cast<KmeansIndex_>(num_subsample), subsample.data());
+            auto subclusters = sanisizer::create<std::vector<KmeansCluster_> >(num_subsample);
+            output = kmeans::compute(static_cast<const KmeansMatrix_&>(submat), *init, *refine, ncenters, my_centers.data(), subclusters.data());
+
+            std::fill(output.sizes.begin(), output.sizes.end(), 0);
+            output.sizes.resize(sanisizer::cast<I<decltype(output.sizes.size())> >(ncenters));
+            assign_to_closest_centers(my_obs, my_data.data(), ncenters, options.num_threads, [&](Index_ o, std::size_t closest, Distance_) -> void {
+                clusters[o] = closest;
+            });
+            for (auto c : clusters) {
+                ++output.sizes[c];
+            }
+
+        } else if constexpr(std::is_same<Data_, KmeansData_>::value) {
+            kmeans::SimpleMatrix<KmeansIndex_, KmeansData_> mat(my_dim, sanisizer::cast<KmeansIndex_>(sanisizer::attest_gez(my_obs)), my_data.data());
+            output = kmeans::compute(mat, *init, *refine, ncenters, my_centers.data(), clusters.data());
+
+        } else {
+            // Converting each observation upon extraction, to avoid holding a converted copy of the entire dataset.
+            typedef ConvertedMatrix<KmeansIndex_, Data_, KmeansData_> Converted;
+            Converted mat(my_dim, sanisizer::cast<KmeansIndex_>(sanisizer::attest_gez(my_obs)), my_data.data());
+
+            if constexpr(std::is_base_of<KmeansMatrix_, Converted>::value) {
+                output = kmeans::compute(static_cast<const KmeansMatrix_&>(mat), *init, *refine, ncenters, my_centers.data(), clusters.data());
+
+            } else if (options.initialize_algorithm == nullptr && options.refine_algorithm == nullptr) {
+                // The default algorithms can be re-created for the converting matrix.
+                kmeans::InitializeKmeansppOptions iopt;
+                iopt.num_threads = options.num_threads;
+                kmeans::InitializeKmeanspp<KmeansIndex_, KmeansData_, KmeansCluster_, KmeansFloat_, Converted> cinit(iopt);
+                kmeans::RefineHartiganWongOptions ropt;
+                ropt.num_threads = options.num_threads;
+                kmeans::RefineHartiganWong<KmeansIndex_, KmeansData_, KmeansCluster_, KmeansFloat_, Converted> crefine(ropt);
+                output = kmeans::compute(mat, cinit, crefine, ncenters, my_centers.data(), clusters.data());
+
+            } else {
+                // User-supplied algorithms for a different matrix class can only be applied to a converted copy.
+                std::vector<KmeansData_> kmeans_data_buffer(my_data.begin(), my_data.end());
+                kmeans::SimpleMatrix<KmeansIndex_, KmeansData_> copy(my_dim, sanisizer::cast<KmeansIndex_>(sanisizer::attest_gez(my_obs)), kmeans_data_buffer.data());
+                output = kmeans::compute(static_cast<const KmeansMatrix_&>(copy), *init, *refine, ncenters, my_centers.data(), clusters.data());
+            }
+        }
+
+        // Removing empty clusters, e.g., due to duplicate points.
+        const auto survivors = kmeans::remove_unused_centers(my_dim, static_cast<KmeansIndex_>(my_obs), clusters.data(), ncenters, my_centers.data(), output.sizes);
+        if (survivors < ncenters) {
+            ncenters = survivors;
+            my_centers.resize(sanisizer::product_unsafe<I<decltype(my_centers.size())> >(ncenters, my_dim));
+            output.sizes.resize(ncenters);
+        }
+
+        if (options.max_cluster_size > 0) {
+            split_large_clusters<KmeansIndex_, KmeansData_>(ncenters, clusters, output.sizes, options.max_cluster_size, options.num_threads);
+        }
+
+        if (options.super_center_power > 0) {
+            cluster_centers<KmeansIndex_>(ncenters, clusters, output.sizes, options.super_center_power, options.num_threads);
+        }
+
+        // Organize points correctly; firstly, sorting by distance from the assigned center.
+        {
+            auto dist_to_assigned = sanisizer::create<std::vector<Distance_> >(sanisizer::attest_gez(my_obs));
+            knncolle::parallelize(options.num_threads, my_obs, [&](int, Index_ start, Index_ length) -> void {
+                static constexpr bool needs_conversion = !std::is_same<KmeansFloat_, Data_>::value;
+                typename std::conditional<needs_conversion, std::vector<KmeansFloat_>, bool>::type conversion_buffer; 
+                if constexpr(needs_conversion) {
+                    sanisizer::resize(conversion_buffer, my_dim);
+                }
+
+                for (Index_ o = start, end = start + length; o < end; ++o) {
+                    auto optr = my_data.data() + sanisizer::product_unsafe<std::size_t>(o, my_dim);
+
+                    const KmeansFloat_* observation = NULL;
+                    if constexpr(needs_conversion) {
+                        std::copy_n(optr, my_dim, conversion_buffer.data());
+                        observation = conversion_buffer.data();
+                    } else {
+                        observation = optr;
+                    }
+
+                    auto cptr = my_centers.data() + sanisizer::product_unsafe<std::size_t>(clusters[o], my_dim);
+                    dist_to_assigned[o] = my_metric_center->normalize(my_metric_center->raw(my_dim, observation, cptr));
+                }
+            });
+
+            organize_observations(ncenters, clusters, output.sizes, dist_to_assigned, options.num_threads);
+        }
+
+        // Permuting the data to mirror the reordered distances, so that the search is more cache-friendly.
+        {
+            const auto& observation_id = my_observation_id;
+            if (!options.reorder_in_place) {
+                // Each row of the new buffer is written sequentially, and different threads write to non-overlapping parts of the buffer.
+                auto reordered = sanisizer::create<std::vector<Data_> >(my_data.size());
+                knncolle::parallelize(options.num_threads, my_obs, [&](int, Index_ start, Index_ length) -> void {
+                    for (Index_ o = start, end = start + length; o < end; ++o) {
+                        auto src = my_data.data() + sanisizer::product_unsafe<std::size_t>(observation_id[o], my_dim);
+                        std::copy_n(src, my_dim, reordered.data() + sanisizer::product_unsafe<std::size_t>(o, my_dim));
+                    }
+                });
+                my_data.swap(reordered);
+
+            } else {
+                // The data itself is permuted serially as each cycle of replacements depends on the previous step.
+                auto used = sanisizer::create<std::vector<unsigned char> >(sanisizer::attest_gez(my_obs));
+                auto buffer = sanisizer::create<std::vector<Data_> >(my_dim);
+                for (Index_ o = 0; o < my_obs; ++o) {
+                    if (used[o]) {
+                        continue;
+                    }
+
+                    Index_ replacement = observation_id[o];
+                    if (replacement == o) {
+                        continue;
+                    }
+
+                    // We recursively perform a "thread" of replacements until we
+                    // are able to find the home of the originally replaced 'o'.
+                    auto optr = my_data.data() + sanisizer::product_unsafe<std::size_t>(o, my_dim);
+                    std::copy_n(optr, my_dim, buffer.data());
+                    do {
+                        auto rptr = my_data.data() + sanisizer::product_unsafe<std::size_t>(replacement, my_dim);
+                        std::copy_n(rptr, my_dim, optr);
+                        used[replacement] = 1;
+                        optr = rptr;
+                        replacement = observation_id[replacement];
+                    } while (replacement != o);
+
+                    std::copy(buffer.begin(), buffer.end(), optr);
+                }
+            }
+        }
+
+        compute_cluster_radii();
+        if (!my_super_offsets.empty()) {
+            compute_super_radii();
+        }
+
+        if (options.quantize) {
+            quantize(options.num_threads);
+        }
+
+        my_num_pivots = options.num_pivots;
+        if (my_num_pivots) {
+            compute_pivots(options.num_threads);
+        }
+
+        my_tiled = options.tile_subjects && my_data_kind != DistanceKind::OTHER;
+        if (my_tiled) {
+            compute_tiles(options.num_threads);
+        }
+    }
+
+    // Streaming construction that never holds all observations of 'data' in memory, see KmknnBuilder::build_streaming_raw().
+    // The centers are fitted to a subsample, and then the reordered data is written to 'dir' and memory-mapped.
+    template<class Matrix_, typename KmeansIndex_, typename KmeansData_, typename KmeansCluster_, class KmeansMatrix_>
+    KmknnPrebuilt(
+        const Matrix_& data,
+        const std::filesystem::path& dir,
+        std::shared_ptr<const DistanceMetricData_> metric_data,
+        std::shared_ptr<const DistanceMetricCenter_> metric_center,
+        const KmknnOptions<Index_, Data_, Distance_, KmeansIndex_, KmeansData_, KmeansCluster_, KmeansFloat_, KmeansMatrix_>& options,
+        const KmknnStreamingOptions& stream_options
+    ) :
+        my_dim(data.num_dimensions()),
+        my_obs(data.num_observations()),
+        my_metric_data(std::move(metric_data)),
+        my_metric_center(std::move(metric_center))
+    {
+        // These all require random access to the observations.
+        if (!options.candidate_powers.empty() || options.max_cluster_size > 0 || options.super_center_power > 0 || options.quantize || options.reorder_dimensions) {
+            throw std::runtime_error("tuning, cluster size limits, super-centers, quantization and dimension reordering are not supported for streaming builds");
+        }
+
+        // Tiles are an in-memory copy of the entire dataset, which defeats the purpose of a streaming build.
+        if (options.tile_subjects) {
+            throw std::runtime_error("tiled subjects are not supported for streaming builds");
+        }
+
+        identify_distances();
+        my_early_abandon_block = options.early_abandon_block;
+        my_power = options.power;
+
         auto init = options.initialize_algorithm;
         if (init == nullptr) {
-            init.reset(new kmeans::InitializeKmeanspp<KmeansIndex_, KmeansData_, KmeansCluster_, KmeansFloat_, KmeansMatrix_>);
+            kmeans::InitializeKmeansppOptions iopt;
+            iopt.num_threads = options.num_threads;
+            init.reset(new kmeans::InitializeKmeanspp<KmeansIndex_, KmeansData_, KmeansCluster_, KmeansFloat_, KmeansMatrix_>(iopt));
         }
         auto refine = options.refine_algorithm;
         if (refine == nullptr) {
-            refine.reset(new kmeans::RefineHartiganWong<KmeansIndex_, KmeansData_, KmeansCluster_, KmeansFloat_, KmeansMatrix_>);
+            kmeans::RefineHartiganWongOptions ropt;
+            ropt.num_threads = options.num_threads;
+            refine.reset(new kmeans::RefineHartiganWong<KmeansIndex_, KmeansData_, KmeansCluster_, KmeansFloat_, KmeansMatrix_>(ropt));
         }
 
-        KmeansCluster_ ncenters = sanisizer::from_float<KmeansCluster_>(std::ceil(std::pow(my_obs, options.power)));
+        // Observations are processed in chunks that fit into the buffer.
+        // The chunk always holds at least one observation, even if there are no observations, so that each pass through 'data' is well-defined.
+        const auto row_bytes = sanisizer::product<std::size_t>(std::max<std::size_t>(my_dim, 1), sizeof(Data_));
+        const Index_ chunk_size = std::min(
+            sanisizer::cast<Index_>(std::max<std::size_t>(stream_options.buffer_size / row_bytes, 1)),
+            std::max<Index_>(my_obs, 1)
+        );
+        auto buffer = sanisizer::create<std::vector<Data_> >(sanisizer::product<std::size_t>(sanisizer::attest_gez(chunk_size), my_dim));
+
+        KmeansCluster_ ncenters = sanisizer::from_float<KmeansCluster_>(std::ceil(std::pow(my_obs, my_power)));
         my_centers.resize(sanisizer::product<I<decltype(my_centers.size())> >(sanisizer::attest_gez(ncenters), my_dim));
 
-        constexpr bool same_data = std::is_same<Data_, KmeansData_>::value;
-        typename std::conditional<same_data, bool, std::vector<KmeansData_> >::type kmeans_data_buffer;
-        const KmeansData_* data_ptr = NULL;
-        if constexpr(same_data) {
-            data_ptr = my_data.data();
-        } else {
-            kmeans_data_buffer.insert(kmeans_data_buffer.end(), my_data.begin(), my_data.end());
-            data_ptr = kmeans_data_buffer.data();
+        // Fitting the centers to a subsample, which is limited to the size of the buffer by default.
+        // As in the in-memory build, the subsample should contain at least one observation per center.
+        {
+            Index_ num_subsample = std::min(options.kmeans_subsample_size > 0 ? options.kmeans_subsample_size : chunk_size, my_obs);
+            if (static_cast<std::size_t>(num_subsample) < static_cast<std::size_t>(ncenters)) {
+                num_subsample = (static_cast<std::size_t>(ncenters) < static_cast<std::size_t>(my_obs) ? static_cast<Index_>(ncenters) : my_obs);
+            }
+
+            const auto chosen = choose_subsample(num_subsample, options.kmeans_subsample_seed);
+            auto subsample = sanisizer::create<std::vector<KmeansData_> >(sanisizer::product<std::size_t>(num_subsample, my_dim));
+            auto work = data.new_known_extractor();
+            Index_ s = 0;
+            for (Index_ o = 0; o < my_obs && s < num_subsample; ++o) {
+                auto ptr = work->next();
+                if (chosen[s] == o) {
+                    std::copy_n(ptr, my_dim, subsample.data() + sanisizer::product_unsafe<std::size_t>(s, my_dim));
+                    ++s;
+                }
+            }
+
+            kmeans::SimpleMatrix<KmeansIndex_, KmeansData_> submat(my_dim, sanisizer::cast<KmeansIndex_>(num_subsample), subsample.data());
+            auto subclusters = sanisizer::create<std::vector<KmeansCluster_> >(num_subsample);
+            kmeans::compute(static_cast<const KmeansMatrix_&>(submat), *init, *refine, ncenters, my_centers.data(), subclusters.data());
         }
 
-        kmeans::SimpleMatrix<KmeansIndex_, KmeansData_> mat(my_dim, sanisizer::cast<KmeansIndex_>(sanisizer::attest_gez(my_obs)), data_ptr);
+        // Assigning each observation to its closest center in a second pass.
         auto clusters = sanisizer::create<std::vector<KmeansCluster_> >(sanisizer::attest_gez(my_obs));
-        auto output = kmeans::compute(mat, *init, *refine, ncenters, my_centers.data(), clusters.data());
+        auto dist_to_assigned = sanisizer::create<std::vector<Distance_> >(sanisizer::attest_gez(my_obs));
+        {
+            auto work = data.new_known_extractor();
+            Index_ first = 0;
+            while (first < my_obs) {
+                const Index_ length = std::min(chunk_size, static_cast<Index_>(my_obs - first));
+                for (Index_ o = 0; o < length; ++o) {
+                    std::copy_n(work->next(), my_dim, buffer.data() + sanisizer::product_unsafe<std::size_t>(o, my_dim));
+                }
+                assign_to_closest_centers(length, buffer.data(), ncenters, options.num_threads, [&](Index_ o, std::size_t closest, Distance_ raw) -> void {
+                    clusters[first + o] = closest;
+                    dist_to_assigned[first + o] = my_metric_center->normalize(raw);
+                });
+                first += length;
+            }
+        }
 
-        // Removing empty clusters, e.g., due to duplicate points.
-        const auto survivors = kmeans::remove_unused_centers(my_dim, static_cast<KmeansIndex_>(my_obs), clusters.data(), ncenters, my_centers.data(), output.sizes);
+        auto sizes = sanisizer::create<std::vector<KmeansIndex_> >(sanisizer::attest_gez(ncenters));
+        for (auto c : clusters) {
+            ++sizes[c];
+        }
+        const auto survivors = kmeans::remove_unused_centers(my_dim, static_cast<KmeansIndex_>(my_obs), clusters.data(), ncenters, my_centers.data(), sizes);
         if (survivors < ncenters) {
             ncenters = survivors;
             my_centers.resize(sanisizer::product_unsafe<I<decltype(my_centers.size())> >(ncenters, my_dim));
-            output.sizes.resize(ncenters);
+            sizes.resize(ncenters);
+        }
+
+        organize_observations(ncenters, clusters, sizes, dist_to_assigned, options.num_threads);
+        compute_cluster_radii();
+
+        // Writing the reordered data in a single pass through 'data', where each observation is written to its final location in the file.
+        // The rows in each chunk are written in order of their locations, so consecutive rows of the same cluster only need a single seek.
+        const auto data_path = dir / "DATA";
+        {
+            std::ofstream output(data_path, std::ios::binary);
+            if (!output) {
+                throw std::runtime_error("failed to open '" + data_path.string() + "'");
+            }
+
+            // Allocating the entire file up front so that later seeks never go past the end.
+            const std::size_t row_size = sanisizer::product<std::size_t>(my_dim, sizeof(Data_));
+            const std::size_t total_size = sanisizer::product<std::size_t>(sanisizer::attest_gez(my_obs), row_size);
+            if (total_size) {
+                output.seekp(total_size - 1);
+                output.put(0);
+            }
+
+            const auto& new_location = my_new_location;
+            auto order = sanisizer::create<std::vector<Index_> >(sanisizer::attest_gez(chunk_size));
+            auto work = data.new_known_extractor();
+            Index_ first = 0;
+            while (first < my_obs) {
+                const Index_ length = std::min(chunk_size, static_cast<Index_>(my_obs - first));
+                for (Index_ o = 0; o < length; ++o) {
+                    std::copy_n(work->next(), my_dim, buffer.data() + sanisizer::product_unsafe<std::size_t>(o, my_dim));
+                }
+
+                std::iota(order.begin(), order.begin() + length, static_cast<Index_>(0));
+                std::sort(order.begin(), order.begin() + length, [&](Index_ left, Index_ right) -> bool {
+                    return new_location[first + left] < new_location[first + right];
+                });
+
+                Index_ last = 0;
+                for (Index_ i = 0; i < length; ++i) {
+                    const auto o = order[i];
+                    const Index_ loc = new_location[first + o];
+                    if (i == 0 || loc != last + 1) {
+                        output.seekp(static_cast<std::streamoff>(sanisizer::product_unsafe<std::size_t>(loc, row_size)));
+                    }
+                    output.write(reinterpret_cast<const char*>(buffer.data() + sanisizer::product_unsafe<std::size_t>(o, my_dim)), row_size);
+                    last = loc;
+                }
+
+                first += length;
+            }
+
+            if (!output) {
+                throw std::runtime_error("failed to write '" + data_path.string() + "'");
+            }
+        }
+
+        DirectoryReader(dir).load("DATA", my_data, sanisizer::product<std::size_t>(sanisizer::attest_gez(my_obs), my_dim), true);
+        my_num_pivots = options.num_pivots;
+        if (my_num_pivots) {
+            compute_pivots(options.num_threads);
         }
+        DirectoryWriter writer(dir);
+        save_metadata(writer);
+    }
 
+private:
+    // Defines the size and offset of each cluster, and sorts the observations in each cluster by their (normalized) distance to the assigned center.
+    // This fills the per-observation arrays, where 'my_observation_id[o]' is the original index of the observation at location 'o'.
+    template<typename KmeansCluster_, typename KmeansIndex_>
+    void organize_observations(
+        KmeansCluster_ ncenters,
+        const std::vector<KmeansCluster_>& clusters,
+        std::vector<KmeansIndex_>& sizes,
+        const std::vector<Distance_>& dist_to_assigned,
+        int num_threads
+    ) {
         if constexpr(std::is_same<Index_, KmeansIndex_>::value) {
-            my_sizes.swap(output.sizes);
+            my_sizes.swap(sizes);
         } else {
-            my_sizes.insert(my_sizes.end(), output.sizes.begin(), output.sizes.end());
+            std::vector<Index_> converted(sizes.begin(), sizes.end());
+            my_sizes.swap(converted);
         }
 
         sanisizer::resize(my_offsets, sanisizer::attest_gez(ncenters));
@@ -433,19 +2077,50 @@ public:
             my_offsets[i] = my_offsets[i - 1] + my_sizes[i - 1];
         }
 
-        // Organize points correctly; firstly, sorting by distance from the assigned center.
-        auto by_distance = sanisizer::create<std::vector<std::pair<Distance_, Index_> > >(sanisizer::attest_gez(my_obs));
-        {
+        // Sorting the original indices directly rather than (distance, index) pairs, to avoid an extra per-observation allocation.
+        // Ties are broken by the original index, so the order is the same as that of the sorted pairs.
+        auto observation_id = sanisizer::create<std::vector<Index_> >(sanisizer::attest_gez(my_obs));
+        std::vector<Index_> sofar(my_offsets.begin(), my_offsets.end());
+        for (Index_ o = 0; o < my_obs; ++o) {
+            observation_id[sofar[clusters[o]]++] = o;
+        }
+
+        knncolle::parallelize(num_threads, ncenters, [&](int, KmeansCluster_ start, KmeansCluster_ length) -> void {
+            for (KmeansCluster_ c = start, end = start + length; c < end; ++c) {
+                auto begin = observation_id.data() + my_offsets[c];
+                std::sort(begin, begin + my_sizes[c], [&](Index_ left, Index_ right) -> bool {
+                    const auto ldist = dist_to_assigned[left], rdist = dist_to_assigned[right];
+                    return ldist < rdist || (ldist == rdist && left < right);
+                });
+            }
+        });
+
+        sanisizer::resize(my_dist_to_centroid, sanisizer::attest_gez(my_obs));
+        sanisizer::resize(my_new_location, sanisizer::attest_gez(my_obs));
+        knncolle::parallelize(num_threads, my_obs, [&](int, Index_ start, Index_ length) -> void {
+            for (Index_ o = start, end = start + length; o < end; ++o) {
+                const auto id = observation_id[o];
+                my_dist_to_centroid[o] = dist_to_assigned[id];
+                my_new_location[id] = o;
+            }
+        });
+        my_observation_id = ArrayStore<Index_>(std::move(observation_id));
+    }
+
+    // Assigns each of the 'num' observations in 'data' to its closest center, in parallel.
+    // This calls 'store(o, closest, closest_raw)' for each observation 'o', where 'closest' is the index of the closest center and 'closest_raw' is the raw distance to that center.
+    template<class Store_>
+    void assign_to_closest_centers(Index_ num, const Data_* data, std::size_t ncenters, int num_threads, Store_ store) const {
+        knncolle::parallelize(num_threads, num, [&](int, Index_ start, Index_ length) -> void {
             static constexpr bool needs_conversion = !std::is_same<KmeansFloat_, Data_>::value;
             typename std::conditional<needs_conversion, std::vector<KmeansFloat_>, bool>::type conversion_buffer; 
             if constexpr(needs_conversion) {
                 sanisizer::resize(conversion_buffer, my_dim);
             }
+            std::vector<Distance_> center_distances(ncenters);
 
-            auto sofar = my_offsets;
-            for (Index_ o = 0; o < my_obs; ++o) {
-                auto optr = my_data.data() + sanisizer::product_unsafe<std::size_t>(o, my_dim);
-
+            for (Index_ o = start, end = start + length; o < end; ++o) {
+                auto optr = data + sanisizer::product_unsafe<std::size_t>(o, my_dim);
                 const KmeansFloat_* observation = NULL;
                 if constexpr(needs_conversion) {
                     std::copy_n(optr, my_dim, conversion_buffer.data());
@@ -454,69 +2129,563 @@ public:
                     observation = optr;
                 }
 
-                auto clustid = clusters[o];
-                auto cptr = my_centers.data() + sanisizer::product_unsafe<std::size_t>(clustid, my_dim);
+                compute_raw_distances(my_center_kind, *my_metric_center, my_dim, observation, my_centers.data(), ncenters, center_distances.data());
+                const std::size_t closest = std::min_element(center_distances.begin(), center_distances.end()) - center_distances.begin();
+                store(o, closest, center_distances[closest]);
+            }
+        });
+    }
+
+    // Selection sampling to choose 'num_sub' observations, so that the observations remain in their original order.
+    template<class Rng_>
+    std::vector<Index_> choose_subsample(Index_ num_sub, Rng_& rng) const {
+        std::vector<Index_> chosen;
+        chosen.reserve(num_sub);
+        for (Index_ o = 0; o < my_obs && static_cast<Index_>(chosen.size()) < num_sub; ++o) {
+            const double remaining = my_obs - o, needed = num_sub - chosen.size();
+            if (std::uniform_real_distribution<double>()(rng) * remaining < needed) {
+                chosen.push_back(o);
+            }
+        }
+        return chosen;
+    }
+
+    std::vector<Index_> choose_subsample(Index_ num_sub, std::uint64_t seed) const {
+        std::mt19937_64 rng(seed);
+        return choose_subsample(num_sub, rng);
+    }
+
+    // Chooses the power from 'options.candidate_powers' that minimizes the number of distance calculations per query in a subsample of the data.
+    // This uses the same code path as the actual search, i.e., KmknnSearcher::search_nn(), so the cost accounts for all of the pruning strategies in the index.
+    template<typename KmeansIndex_, typename KmeansData_, typename KmeansCluster_, class KmeansMatrix_>
+    double tune_power(const KmknnOptions<Index_, Data_, Distance_, KmeansIndex_, KmeansData_, KmeansCluster_, KmeansFloat_, KmeansMatrix_>& options) const {
+        const auto& candidates = options.candidate_powers;
+        const Index_ num_sub = std::min(my_obs, options.tuning_subsample_size);
+        if (candidates.size() == 1 || num_sub < 2) {
+            return candidates.front();
+        }
 
-                auto& counter = sofar[clustid];
-                auto& current = by_distance[counter];
-                current.first = my_metric_center->normalize(my_metric_center->raw(my_dim, observation, cptr));
-                current.second = o;
+        std::mt19937_64 rng(options.tuning_seed);
+        const auto chosen = choose_subsample(num_sub, rng);
+
+        auto subsample = sanisizer::create<std::vector<Data_> >(sanisizer::product<std::size_t>(num_sub, my_dim));
+        for (Index_ s = 0; s < num_sub; ++s) {
+            std::copy_n(my_data.data() + sanisizer::product_unsafe<std::size_t>(chosen[s], my_dim), my_dim, subsample.data() + sanisizer::product_unsafe<std::size_t>(s, my_dim));
+        }
 
-                ++counter;
+        const Index_ num_queries = std::min(num_sub, options.tuning_num_queries);
+        std::vector<Index_> queries(num_sub);
+        std::iota(queries.begin(), queries.end(), static_cast<Index_>(0));
+        std::shuffle(queries.begin(), queries.end(), rng);
+        queries.resize(num_queries);
+        const Index_ k = std::max(static_cast<Index_>(1), std::min(options.tuning_num_neighbors, static_cast<Index_>(num_sub - 1)));
+
+        auto sub_options = options;
+        sub_options.candidate_powers.clear();
+        sub_options.quantize = false; // doesn't affect the number of distance calculations.
+        sub_options.reorder_dimensions = false; // the dimensions of 'my_data' were already reordered.
+        sub_options.num_pivots = 0; // pivots are only used to skip distance calculations after they are counted.
+        sub_options.tile_subjects = false; // doesn't affect the number of distance calculations.
+
+        double best_power = candidates.front();
+        std::size_t best_cost = std::numeric_limits<std::size_t>::max();
+        for (auto power : candidates) {
+            // Choosing the power for the subsample such that the average number of observations per cluster is the same as that of the full dataset.
+            const double full_centers = std::ceil(std::pow(my_obs, power));
+            const double sub_centers = std::max(1.0, std::round(full_centers * static_cast<double>(num_sub) / static_cast<double>(my_obs)));
+            sub_options.power = std::log(sub_centers) / std::log(static_cast<double>(num_sub));
+
+            KmknnPrebuilt candidate(my_dim, num_sub, subsample, my_metric_data, my_metric_center, sub_options);
+            KmknnSearcher<Index_, Data_, Distance_, DistanceMetricData_, KmeansFloat_, DistanceMetricCenter_, true> searcher(candidate);
+            for (auto q : queries) {
+                searcher.search(q, k, NULL, NULL);
             }
 
-            for (KmeansCluster_ c = 0; c < ncenters; ++c) {
-                auto begin = by_distance.data() + my_offsets[c];
-                std::sort(begin, begin + my_sizes[c]);
+            if (searcher.my_num_evaluations < best_cost) {
+                best_cost = searcher.my_num_evaluations;
+                best_power = power;
             }
         }
 
-        // Permuting in-place to mirror the reordered distances, so that the search is more cache-friendly.
-        {
-            auto used = sanisizer::create<std::vector<unsigned char> >(sanisizer::attest_gez(my_obs));
-            auto buffer = sanisizer::create<std::vector<Data_> >(my_dim);
-            sanisizer::resize(my_observation_id, sanisizer::attest_gez(my_obs));
-            sanisizer::resize(my_dist_to_centroid, sanisizer::attest_gez(my_obs));
-            sanisizer::resize(my_new_location, sanisizer::attest_gez(my_obs));
+        return best_power;
+    }
+
+public:
+    /**
+     * @return Power of the number of observations used to define the number of cluster centers.
+     * This is either `KmknnOptions::power` or the value chosen from `KmknnOptions::candidate_powers`.
+     */
+    double get_power() const {
+        return my_power;
+    }
 
+private:
+    // Collects the existing observations in their original order (and with their original dimensions), followed by the new observations.
+    std::vector<Data_> collect_original_data(Index_ num_new, const Data_* new_data) const {
+        auto collected = sanisizer::create<std::vector<Data_> >(sanisizer::product<std::size_t>(sanisizer::sum<std::size_t>(sanisizer::attest_gez(my_obs), sanisizer::attest_gez(num_new)), my_dim));
+        for (Index_ o = 0; o < my_obs; ++o) {
+            auto src = my_data.data() + sanisizer::product_unsafe<std::size_t>(my_new_location[o], my_dim);
+            auto dest = collected.data() + sanisizer::product_unsafe<std::size_t>(o, my_dim);
+            if (my_dimension_order.empty()) {
+                std::copy_n(src, my_dim, dest);
+            } else {
+                for (std::size_t d = 0; d < my_dim; ++d) {
+                    dest[my_dimension_order[d]] = src[d];
+                }
+            }
+        }
+        std::copy_n(new_data, sanisizer::product_unsafe<std::size_t>(num_new, my_dim), collected.data() + sanisizer::product_unsafe<std::size_t>(my_obs, my_dim));
+        return collected;
+    }
+
+    // Rebuilds the index from scratch with all existing and new observations, preserving any deletions.
+    template<typename KmeansIndex_, typename KmeansData_, typename KmeansCluster_, class KmeansMatrix_>
+    void rebuild(Index_ num_new, const Data_* new_data, const KmknnOptions<Index_, Data_, Distance_, KmeansIndex_, KmeansData_, KmeansCluster_, KmeansFloat_, KmeansMatrix_>& options) {
+        std::vector<Index_> deleted_ids;
+        if (!my_deleted.empty()) {
+            const auto& new_location = my_new_location; // const reference to avoid materializing a memory-mapped array.
             for (Index_ o = 0; o < my_obs; ++o) {
-                if (used[o]) {
+                if (my_deleted[new_location[o]]) {
+                    deleted_ids.push_back(o);
+                }
+            }
+        }
+
+        const Index_ total = sanisizer::sum<Index_>(sanisizer::attest_gez(my_obs), sanisizer::attest_gez(num_new));
+        *this = KmknnPrebuilt(my_dim, total, collect_original_data(num_new, new_data), my_metric_data, my_metric_center, options);
+        for (auto d : deleted_ids) {
+            remove(d);
+        }
+    }
+
+public:
+    /**
+     * Add new observations to the index without repeating the k-means clustering.
+     * Each new observation is assigned to its closest center and inserted into that cluster's sorted range,
+     * such that the search results are the same as those from an index built from all observations.
+     * The new observations are indexed from `num_observations()` onwards, in the order in which they are supplied.
+     *
+     * The centers are not updated, so the clustering will become less efficient for the search as more observations are added.
+     * If `KmknnOptions::recluster_imbalance` is positive and the cluster sizes become too imbalanced, the entire index is rebuilt from all observations with `options`.
+     *
+     * This invalidates any existing searchers, which should be re-created with `initialize()` or `initialize_known()`.
+     *
+     * @param num_new Number of new observations.
+     * @param new_data Pointer to an array of length equal to the product of `num_new` and `num_dimensions()`.
+     * This should contain the coordinates of each new observation in a column-major matrix where rows are dimensions and columns are observations.
+     * @param options Further options.
+     * Only `num_threads` and `recluster_imbalance` are used, unless the index is rebuilt.
+     */
+    template<typename KmeansIndex_, typename KmeansData_, typename KmeansCluster_, class KmeansMatrix_>
+    void add(Index_ num_new, const Data_* new_data, const KmknnOptions<Index_, Data_, Distance_, KmeansIndex_, KmeansData_, KmeansCluster_, KmeansFloat_, KmeansMatrix_>& options) {
+        if (num_new == 0) {
+            return;
+        }
+
+        const auto ncenters = my_sizes.size();
+        const Index_ total = sanisizer::sum<Index_>(sanisizer::attest_gez(my_obs), sanisizer::attest_gez(num_new));
+        if (ncenters == 0) {
+            // No clusters to insert into, e.g., because the index was empty.
+            rebuild(num_new, new_data, options);
+            return;
+        }
+
+        std::vector<Data_> permuted;
+        new_data = permute_dimensions(new_data, num_new, permuted);
+
+        // Assigning each new observation to its closest center.
+        auto assigned = sanisizer::create<std::vector<std::size_t> >(sanisizer::attest_gez(num_new));
+        auto dist_to_assigned = sanisizer::create<std::vector<Distance_> >(sanisizer::attest_gez(num_new));
+        assign_to_closest_centers(num_new, new_data, ncenters, options.num_threads, [&](Index_ o, std::size_t closest, Distance_ closest_raw) -> void {
+            assigned[o] = closest;
+            dist_to_assigned[o] = my_metric_center->normalize(closest_raw);
+        });
+
+        // Sorting the new observations by distance within each cluster, as done in the constructor.
+        auto added_sizes = sanisizer::create<std::vector<Index_> >(ncenters);
+        for (auto a : assigned) {
+            ++added_sizes[a];
+        }
+        auto added_offsets = sanisizer::create<std::vector<Index_> >(ncenters);
+        for (std::size_t c = 1; c < ncenters; ++c) {
+            added_offsets[c] = added_offsets[c - 1] + added_sizes[c - 1];
+        }
+
+        auto incoming = sanisizer::create<std::vector<std::pair<Distance_, Index_> > >(sanisizer::attest_gez(num_new));
+        {
+            auto sofar = added_offsets;
+            for (Index_ o = 0; o < num_new; ++o) {
+                auto& current = incoming[sofar[assigned[o]]++];
+                current.first = dist_to_assigned[o];
+                current.second = my_obs + o;
+            }
+        }
+
+        // Const references ensure that we only read from any memory-mapped arrays, rather than materializing them via get_mutable() in each worker.
+        const auto& old_offsets = my_offsets;
+        const auto& old_sizes = my_sizes;
+        const auto& old_data = my_data;
+        const auto& old_id = my_observation_id;
+        const auto& old_dist = my_dist_to_centroid;
+        const auto& old_deleted = my_deleted;
+
+        auto new_offsets = sanisizer::create<std::vector<Index_> >(ncenters);
+        for (std::size_t c = 1; c < ncenters; ++c) {
+            new_offsets[c] = new_offsets[c - 1] + old_sizes[c - 1] + added_sizes[c - 1];
+        }
+
+        // Merging the new observations into each cluster's range, which only requires a linear pass through the existing arrays.
+        // New observations are placed after any existing observations with the same distance, consistent with the sorting of (distance, index) pairs in the constructor. 
+        auto merged_data = sanisizer::create<std::vector<Data_> >(sanisizer::product<std::size_t>(sanisizer::attest_gez(total), my_dim));
+        auto merged_id = sanisizer::create<std::vector<Index_> >(sanisizer::attest_gez(total));
+        auto merged_dist = sanisizer::create<std::vector<Distance_> >(sanisizer::attest_gez(total));
+        std::vector<unsigned char> merged_deleted;
+        if (!my_deleted.empty()) {
+            sanisizer::resize(merged_deleted, sanisizer::attest_gez(total));
+        }
+        knncolle::parallelize(options.num_threads, ncenters, [&](int, std::size_t start, std::size_t length) -> void {
+            for (std::size_t c = start, end = start + length; c < end; ++c) {
+                auto inc_begin = incoming.data() + added_offsets[c];
+                std::sort(inc_begin, inc_begin + added_sizes[c]);
+
+                Index_ old_pos = old_offsets[c], old_end = old_pos + old_sizes[c];
+                Index_ inc_pos = 0, inc_end = added_sizes[c];
+                Index_ out = new_offsets[c];
+                for (; old_pos < old_end || inc_pos < inc_end; ++out) {
+                    const Data_* src;
+                    if (inc_pos == inc_end || (old_pos < old_end && old_dist[old_pos] <= inc_begin[inc_pos].first)) {
+                        merged_id[out] = old_id[old_pos];
+                        merged_dist[out] = old_dist[old_pos];
+                        src = old_data.data() + sanisizer::product_unsafe<std::size_t>(old_pos, my_dim);
+                        if (!merged_deleted.empty()) {
+                            merged_deleted[out] = old_deleted[old_pos];
+                        }
+                        ++old_pos;
+                    } else {
+                        const auto& current = inc_begin[inc_pos];
+                        merged_id[out] = current.second;
+                        merged_dist[out] = current.first;
+                        src = new_data + sanisizer::product_unsafe<std::size_t>(current.second - my_obs, my_dim);
+                        ++inc_pos;
+                    }
+                    std::copy_n(src, my_dim, merged_data.data() + sanisizer::product_unsafe<std::size_t>(out, my_dim));
+                }
+            }
+        });
+
+        auto merged_location = sanisizer::create<std::vector<Index_> >(sanisizer::attest_gez(total));
+        for (Index_ o = 0; o < total; ++o) {
+            merged_location[merged_id[o]] = o;
+        }
+
+        for (std::size_t c = 0; c < ncenters; ++c) {
+            added_sizes[c] += old_sizes[c];
+        }
+        my_sizes = ArrayStore<Index_>(std::move(added_sizes));
+        my_offsets = ArrayStore<Index_>(std::move(new_offsets));
+        my_data = ArrayStore<Data_>(std::move(merged_data));
+        my_observation_id = ArrayStore<Index_>(std::move(merged_id));
+        my_new_location = ArrayStore<Index_>(std::move(merged_location));
+        my_dist_to_centroid = ArrayStore<Distance_>(std::move(merged_dist));
+        my_deleted.swap(merged_deleted);
+        my_obs = total;
+
+        if (options.recluster_imbalance > 0) {
+            const auto largest = *std::max_element(my_sizes.begin(), my_sizes.end());
+            if (largest > options.recluster_imbalance * static_cast<double>(my_obs) / static_cast<double>(ncenters)) {
+                rebuild(0, NULL, options);
+                return;
+            }
+        }
+
+        // Radii of the clusters and super-centers may have increased.
+        compute_cluster_radii();
+        if (!my_super_offsets.empty()) {
+            compute_super_radii();
+        }
+
+        // Quantization ranges need to be recomputed as the new observations may lie outside of the existing range.
+        if (!my_quantized_scale.empty()) {
+            quantize(options.num_threads);
+        }
+
+        if (my_num_pivots) {
+            compute_pivots(options.num_threads);
+        }
+
+        if (my_tiled) {
+            compute_tiles(options.num_threads);
+        }
+    }
+
+    /**
+     * Overload of `add()` with default options.
+     * If the index needs to be rebuilt (e.g., because it has no clusters), the rebuild uses the same settings as the construction of this index,
+     * i.e., its power, early abandonment, quantization, dimension reordering, pivots, tiling, super-centers and cluster size limit.
+     *
+     * @param num_new Number of new observations.
+     * @param new_data Pointer to an array of length equal to the product of `num_new` and `num_dimensions()`, containing the coordinates of each new observation.
+     */
+    void add(Index_ num_new, const Data_* new_data) {
+        KmknnOptions<Index_, Data_, Distance_, Index_, Data_, Index_, KmeansFloat_> options;
+        options.power = my_power;
+        options.early_abandon_block = my_early_abandon_block;
+        options.quantize = my_quantize;
+        options.reorder_dimensions = my_reorder_dimensions;
+        options.num_pivots = my_num_pivots;
+        options.tile_subjects = my_tiled;
+        options.super_center_power = my_super_center_power;
+        options.max_cluster_size = my_max_cluster_size;
+        add(num_new, new_data, options);
+    }
+
+    /**
+     * Mark an observation as deleted, so that it is no longer reported by any searches.
+     * This is a constant-time operation that does not change the indices of any other observations.
+     * Deleted observations can still be used as queries in `knncolle::Searcher::search()` and `knncolle::Searcher::search_all()`.
+     *
+     * Existing searchers should not be used concurrently with this method.
+     *
+     * @param i Index of the observation to delete.
+     * This should be less than `num_observations()`.
+     * Deleting an already-deleted observation is a no-op.
+     */
+    void remove(Index_ i) {
+        if (my_deleted.empty()) {
+            sanisizer::resize(my_deleted, sanisizer::attest_gez(my_obs));
+        }
+        const auto& new_location = my_new_location; // const reference to avoid materializing a memory-mapped array.
+        auto& current = my_deleted[new_location[i]];
+        if (!current) {
+            current = 1;
+            ++my_num_deleted;
+        }
+    }
+
+    /**
+     * @return Number of observations that were deleted with `remove()` and not yet removed by `compact()`.
+     */
+    Index_ num_deleted() const {
+        return my_num_deleted;
+    }
+
+    /**
+     * Physically remove all deleted observations from the index, in time linear to the number of observations.
+     * Remaining observations are re-indexed from zero in order of their previous indices.
+     * Any clusters that are emptied by the deletions are also removed.
+     *
+     * This invalidates any existing searchers, which should be re-created with `initialize()` or `initialize_known()`.
+     *
+     * @return Vector of length equal to the new `num_observations()`.
+     * Each entry contains the previous index of the observation with the new index equal to its position in the vector.
+     */
+    std::vector<Index_> compact() {
+        std::vector<Index_> retained;
+        if (my_num_deleted == 0) {
+            retained.resize(sanisizer::cast<I<decltype(retained.size())> >(sanisizer::attest_gez(my_obs)));
+            std::iota(retained.begin(), retained.end(), static_cast<Index_>(0));
+            return retained;
+        }
+
+        auto remapping = sanisizer::create<std::vector<Index_> >(sanisizer::attest_gez(my_obs));
+        retained.reserve(my_obs - my_num_deleted);
+        const auto& new_location = my_new_location; // const reference to avoid materializing a memory-mapped array.
+        for (Index_ o = 0; o < my_obs; ++o) {
+            if (!my_deleted[new_location[o]]) {
+                remapping[o] = retained.size();
+                retained.push_back(o);
+            }
+        }
+
+        // Shifting the remaining observations forward in a single pass, so all writes are to positions at or before the current read.
+        auto& data = my_data.get_mutable();
+        auto& ids = my_observation_id.get_mutable();
+        auto& dists = my_dist_to_centroid.get_mutable();
+        auto& sizes = my_sizes.get_mutable();
+        auto& offsets = my_offsets.get_mutable();
+        auto& centers = my_centers.get_mutable();
+        const bool quantized = !my_quantized.empty();
+        auto& codes = my_quantized.get_mutable();
+
+        const auto ncenters = sizes.size();
+        I<decltype(ncenters)> new_ncenters = 0;
+        std::vector<std::size_t> kept_centers(ncenters + 1); // number of retained centers before each center.
+        Index_ out = 0;
+        for (I<decltype(ncenters)> c = 0; c < ncenters; ++c) {
+            kept_centers[c] = new_ncenters;
+            const Index_ new_offset = out;
+            for (Index_ loc = offsets[c], end = offsets[c] + sizes[c]; loc < end; ++loc) {
+                if (my_deleted[loc]) {
                     continue;
                 }
+                if (out != loc) {
+                    const auto src = sanisizer::product_unsafe<std::size_t>(loc, my_dim), dest = sanisizer::product_unsafe<std::size_t>(out, my_dim);
+                    std::copy_n(data.data() + src, my_dim, data.data() + dest);
+                    if (quantized) {
+                        std::copy_n(codes.data() + src, my_dim, codes.data() + dest);
+                    }
+                    dists[out] = dists[loc];
+                }
+                ids[out] = remapping[ids[loc]];
+                ++out;
+            }
 
-                const auto& current = by_distance[o];
-                my_observation_id[o] = current.second;
-                my_dist_to_centroid[o] = current.first;
-                my_new_location[current.second] = o;
-                if (current.second == o) {
+            if (out == new_offset) {
+                continue;
+            }
+            if (new_ncenters != c) {
+                std::copy_n(centers.data() + sanisizer::product_unsafe<std::size_t>(c, my_dim), my_dim, centers.data() + sanisizer::product_unsafe<std::size_t>(new_ncenters, my_dim));
+            }
+            offsets[new_ncenters] = new_offset;
+            sizes[new_ncenters] = out - new_offset;
+            ++new_ncenters;
+        }
+        kept_centers[ncenters] = new_ncenters;
+
+        my_obs = out;
+        data.resize(sanisizer::product_unsafe<std::size_t>(my_obs, my_dim));
+        ids.resize(my_obs);
+        dists.resize(my_obs);
+        if (quantized) {
+            codes.resize(data.size());
+        }
+        sizes.resize(new_ncenters);
+        offsets.resize(new_ncenters);
+        centers.resize(sanisizer::product_unsafe<std::size_t>(new_ncenters, my_dim));
+
+        // Every location is overwritten, so there's no need to copy a memory-mapped array with get_mutable().
+        auto locations = sanisizer::create<std::vector<Index_> >(sanisizer::attest_gez(my_obs));
+        for (Index_ o = 0; o < my_obs; ++o) {
+            locations[ids[o]] = o;
+        }
+        my_new_location = ArrayStore<Index_>(std::move(locations));
+
+        compute_cluster_radii();
+
+        // Removing centers from their super-centers, and discarding super-centers without any remaining centers.
+        if (!my_super_offsets.empty()) {
+            const auto old_offsets = my_super_offsets;
+            const auto nsuper = old_offsets.size() - 1;
+            std::size_t new_nsuper = 0;
+            for (std::size_t g = 0; g < nsuper; ++g) {
+                const auto first = kept_centers[old_offsets[g]], last = kept_centers[old_offsets[g + 1]];
+                if (first == last) {
                     continue;
                 }
+                if (new_nsuper != g) {
+                    std::copy_n(
+                        my_super_centers.data() + sanisizer::product_unsafe<std::size_t>(g, my_dim),
+                        my_dim,
+                        my_super_centers.data() + sanisizer::product_unsafe<std::size_t>(new_nsuper, my_dim)
+                    );
+                }
+                my_super_offsets[new_nsuper + 1] = last;
+                ++new_nsuper;
+            }
+            my_super_offsets.resize(new_nsuper + 1);
+            my_super_centers.resize(sanisizer::product_unsafe<std::size_t>(new_nsuper, my_dim));
+            compute_super_radii();
+        }
 
-                // We recursively perform a "thread" of replacements until we
-                // are able to find the home of the originally replaced 'o'.
-                auto optr = my_data.data() + sanisizer::product_unsafe<std::size_t>(o, my_dim);
-                std::copy_n(optr, my_dim, buffer.data());
-                Index_ replacement = current.second;
-                do {
-                    auto rptr = my_data.data() + sanisizer::product_unsafe<std::size_t>(replacement, my_dim);
-                    std::copy_n(rptr, my_dim, optr);
-                    used[replacement] = 1;
-
-                    const auto& next = by_distance[replacement];
-                    my_observation_id[replacement] = next.second;
-                    my_dist_to_centroid[replacement] = next.first;
-                    my_new_location[next.second] = replacement;
-
-                    optr = rptr;
-                    replacement = next.second;
-                } while (replacement != o);
+        if (my_num_pivots) {
+            compute_pivots(1);
+        }
+        if (my_tiled) {
+            compute_tiles(1);
+        }
 
-                std::copy(buffer.begin(), buffer.end(), optr);
-            }
+        my_deleted.clear();
+        my_deleted.shrink_to_fit();
+        my_num_deleted = 0;
+        return retained;
+    }
+
+    /**
+     * Find the `k` nearest neighbors of every observation in the index.
+     * This is equivalent to calling `knncolle::Searcher::search()` for each observation but is more efficient.
+     * Observations are processed cluster by cluster, where the ordering of centers by their distance from each cluster's center is reused for all observations in that cluster;
+     * the triangle inequality allows us to skip distant clusters without scanning their observations.
+     * The distances from the observations in each cluster to all centers are computed in cache-friendly blocks, as in `KmknnSearcher::search_batch()`.
+     *
+     * @param k Number of nearest neighbors.
+     * If this is greater than the number of other observations, all other observations are reported as neighbors.
+     * @param num_threads Number of threads to use.
+     *
+     * @return The k-nearest neighbor graph, where each observation's neighbors are stored in the same order as the output of `knncolle::Searcher::search()`.
+     */
+    KmknnNeighborGraph<Index_, Distance_> build_knn_graph(Index_ k, int num_threads) const {
+        KmknnNeighborGraph<Index_, Distance_> output;
+        sanisizer::resize(output.pointers, sanisizer::sum<std::size_t>(sanisizer::attest_gez(my_obs), 1));
+        const Index_ num_alive = my_obs - my_num_deleted;
+        for (Index_ o = 0; o < my_obs; ++o) {
+            const Index_ available = (is_deleted(my_new_location[o]) ? num_alive : num_alive - 1);
+            output.pointers[o + 1] = output.pointers[o] + std::min(k, available);
         }
+
+        const auto total = output.pointers.back();
+        sanisizer::resize(output.indices, total);
+        sanisizer::resize(output.distances, total);
+        if (total == 0) {
+            return output;
+        }
+
+        const auto ncenters = my_sizes.size();
+        const Distance_ max_radius = this->max_radius();
+        const auto& observation_id = my_observation_id;
+
+        knncolle::parallelize(num_threads, ncenters, [&](int, I<decltype(ncenters)> start, I<decltype(ncenters)> length) -> void {
+            typedef KmknnSearcher<Index_, Data_, Distance_, DistanceMetricData_, KmeansFloat_, DistanceMetricCenter_> Searcher;
+            Searcher searcher(*this);
+            std::vector<Distance_> host_distances(ncenters);
+            std::vector<std::pair<Distance_, Index_> > host_order;
+            host_order.reserve(ncenters);
+            std::vector<std::vector<Index_> > batch_indices(Searcher::batch_query_block);
+            std::vector<std::vector<Distance_> > batch_distances(Searcher::batch_query_block);
+
+            for (auto h = start, end = start + length; h < end; ++h) {
+                compute_raw_distances(
+                    my_center_kind,
+                    *my_metric_center,
+                    my_dim,
+                    my_centers.data() + sanisizer::product_unsafe<std::size_t>(h, my_dim),
+                    my_centers.data(),
+                    ncenters,
+                    host_distances.data()
+                );
+                host_order.clear();
+                for (I<decltype(ncenters)> c = 0; c < ncenters; ++c) {
+                    host_order.emplace_back(my_metric_center->normalize(host_distances[c]), c);
+                }
+                std::sort(host_order.begin(), host_order.end());
+
+                const Index_ host_end = my_offsets[h] + my_sizes[h];
+                Index_ first = my_offsets[h];
+                while (first < host_end) {
+                    const Index_ num = std::min(Searcher::batch_query_block, static_cast<Index_>(host_end - first));
+                    searcher.search_batch_from_host(first, num, k, host_order, max_radius, batch_indices.data(), batch_distances.data());
+
+                    // Converting the locations to the original indices and normalizing the distances as they are stored in the graph.
+                    for (Index_ q = 0; q < num; ++q) {
+                        const auto row_start = output.pointers[observation_id[first + q]];
+                        const auto& cur_indices = batch_indices[q];
+                        const auto& cur_distances = batch_distances[q];
+                        const auto num_neighbors = cur_indices.size();
+                        for (I<decltype(num_neighbors)> j = 0; j < num_neighbors; ++j) {
+                            output.indices[row_start + j] = observation_id[cur_indices[j]];
+                            output.distances[row_start + j] = my_metric_data->normalize(cur_distances[j]);
+                        }
+                    }
+
+                    first += num;
+                }
+            }
+        });
+
+        return output;
     }
 
-    friend class KmknnSearcher<Index_, Data_, Distance_, DistanceMetricData_, KmeansFloat_, DistanceMetricCenter_>;
+    template<typename, typename, typename, class, class, class, bool>
+    friend class KmknnSearcher;
 
 public:
     std::unique_ptr<knncolle::Searcher<Index_, Data_, Distance_> > initialize() const {
@@ -527,67 +2696,197 @@ public:
         return std::make_unique<KmknnSearcher<Index_, Data_, Distance_, DistanceMetricData_, KmeansFloat_, DistanceMetricCenter_> >(*this);
     }
 
+    /**
+     * @param options Options for approximate searches.
+     * @return A searcher that uses the approximations in `options` for its k-nearest neighbor searches.
+     */
+    std::unique_ptr<knncolle::Searcher<Index_, Data_, Distance_> > initialize(const KmknnSearchOptions& options) const {
+        return initialize_known(options);
+    }
+
+    /**
+     * @param options Options for approximate searches.
+     * @return A searcher that uses the approximations in `options` for its k-nearest neighbor searches.
+     */
+    auto initialize_known(const KmknnSearchOptions& options) const {
+        return std::make_unique<KmknnSearcher<Index_, Data_, Distance_, DistanceMetricData_, KmeansFloat_, DistanceMetricCenter_> >(*this, options);
+    }
+
 public:
     void save(const std::filesystem::path& dir) const {
-        knncolle::quick_save(dir / "ALGORITHM", kmknn_prebuilt_save_name, std::strlen(kmknn_prebuilt_save_name));
-        knncolle::quick_save(dir / "DATA", my_data.data(), my_data.size());
-        knncolle::quick_save(dir / "NUM_OBS", &my_obs, 1);
-        knncolle::quick_save(dir / "NUM_DIM", &my_dim, 1);
-        const auto num_centers = my_sizes.size();
-        knncolle::quick_save(dir / "NUM_CENTERS", &num_centers, 1);
-
-        knncolle::quick_save(dir / "SIZES", my_sizes.data(), my_sizes.size());
-        knncolle::quick_save(dir / "OFFSETS", my_offsets.data(), my_offsets.size());
-        knncolle::quick_save(dir / "CENTERS", my_centers.data(), my_centers.size());
-        knncolle::quick_save(dir / "OBSERVATION_ID", my_observation_id.data(), my_observation_id.size());
-        knncolle::quick_save(dir / "NEW_LOCATION", my_new_location.data(), my_new_location.size());
-        knncolle::quick_save(dir / "DIST_TO_CENTROID", my_dist_to_centroid.data(), my_dist_to_centroid.size());
-
-        auto float_type = knncolle::get_numeric_type<KmeansFloat_>();
-        knncolle::quick_save(dir / "FLOAT_TYPE", &float_type, 1);
-        auto& kfcust = custom_save_for_kmknn_kmeansfloat<KmeansFloat_>(); 
-        if (kfcust) {
-            kfcust(dir); 
+        DirectoryWriter writer(dir);
+        write_sections(writer);
+    }
+
+    /**
+     * @cond
+     */
+    void save_sections(ContainerWriter& writer) const {
+        write_sections(writer);
+    }
+    /**
+     * @endcond
+     */
+
+private:
+    // 'Writer_' is either a DirectoryWriter for save(), or a ContainerWriter for save_kmknn_prebuilt_file().
+    template<class Writer_>
+    void write_sections(Writer_& writer) const {
+        writer.save("DATA", my_data.data(), my_data.size());
+        save_metadata(writer);
+    }
+
+    // Saves everything except for the data, which is written separately by the streaming build.
+    template<class Writer_>
+    void save_metadata(Writer_& writer) const {
+        writer.save("ALGORITHM", kmknn_prebuilt_save_name, std::strlen(kmknn_prebuilt_save_name));
+        writer.save_value("NUM_OBS", my_obs);
+        writer.save_value("NUM_DIM", my_dim);
+        writer.save_value("NUM_CENTERS", my_sizes.size());
+
+        writer.save("SIZES", my_sizes.data(), my_sizes.size());
+        writer.save("OFFSETS", my_offsets.data(), my_offsets.size());
+        writer.save("CENTERS", my_centers.data(), my_centers.size());
+        writer.save("OBSERVATION_ID", my_observation_id.data(), my_observation_id.size());
+        writer.save("NEW_LOCATION", my_new_location.data(), my_new_location.size());
+        writer.save("DIST_TO_CENTROID", my_dist_to_centroid.data(), my_dist_to_centroid.size());
+        writer.save_value("EARLY_ABANDON", my_early_abandon_block);
+        writer.save_value("POWER", my_power);
+        if (!my_dimension_order.empty()) {
+            writer.save("DIMENSION_ORDER", my_dimension_order.data(), my_dimension_order.size());
+        }
+        if (my_num_pivots) {
+            writer.save_value("NUM_PIVOTS", my_num_pivots);
+            writer.save("PIVOTS", my_pivots.data(), my_pivots.size());
+            writer.save("PIVOT_DISTANCES", my_pivot_distances.data(), my_pivot_distances.size());
+        }
+        if (my_tiled) {
+            // Tiles are not saved as they are cheap to recompute from the data upon loading.
+            writer.save_value("TILED", static_cast<unsigned char>(1));
+        }
+        if (my_quantize) {
+            writer.save_value("QUANTIZE", static_cast<unsigned char>(1));
+        }
+        if (my_reorder_dimensions) {
+            writer.save_value("REORDER_DIMENSIONS", static_cast<unsigned char>(1));
+        }
+        if (my_super_center_power > 0) {
+            writer.save_value("SUPER_CENTER_POWER", my_super_center_power);
+        }
+        if (my_max_cluster_size > 0) {
+            writer.save_value("MAX_CLUSTER_SIZE", my_max_cluster_size);
+        }
+        if (my_num_deleted) {
+            writer.save("DELETED", my_deleted.data(), my_deleted.size());
         }
 
-        {
-            const auto distdir = dir / "DISTANCE_DATA";
-            std::filesystem::create_directory(distdir);
-            my_metric_data->save(distdir);
+        if (!my_super_offsets.empty()) {
+            writer.save_value("NUM_SUPER_CENTERS", static_cast<std::size_t>(my_super_radius.size()));
+            writer.save("SUPER_OFFSETS", my_super_offsets.data(), my_super_offsets.size());
+            writer.save("SUPER_CENTERS", my_super_centers.data(), my_super_centers.size());
+            writer.save("SUPER_RADIUS", my_super_radius.data(), my_super_radius.size());
         }
 
-        {
-            const auto distdir = dir / "DISTANCE_CENTER";
-            std::filesystem::create_directory(distdir);
-            my_metric_center->save(distdir);
+        if (!my_quantized_scale.empty()) {
+            writer.save("QUANTIZED", my_quantized.data(), my_quantized.size());
+            writer.save("QUANTIZED_MIN", my_quantized_min.data(), my_quantized_min.size());
+            writer.save("QUANTIZED_SCALE", my_quantized_scale.data(), my_quantized_scale.size());
+            writer.save_value("QUANTIZED_ERROR", my_quantized_error);
+        }
+
+        writer.save_value("FLOAT_TYPE", knncolle::get_numeric_type<KmeansFloat_>());
+        auto& kfcust = custom_save_for_kmknn_kmeansfloat<KmeansFloat_>(); 
+        if (kfcust) {
+            writer.save_directory("", kfcust);
         }
+
+        writer.save_directory("DISTANCE_DATA", [&](const std::filesystem::path& distdir) -> void { my_metric_data->save(distdir); });
+        writer.save_directory("DISTANCE_CENTER", [&](const std::filesystem::path& distdir) -> void { my_metric_center->save(distdir); });
     }
 
-    KmknnPrebuilt(const std::filesystem::path& dir) {
-        knncolle::quick_load(dir / "NUM_OBS", &my_obs, 1);
-        knncolle::quick_load(dir / "NUM_DIM", &my_dim, 1);
+private:
+    // 'Reader_' is either a DirectoryReader for a directory created by save(), or a ContainerReader for a file created by save_kmknn_prebuilt_file().
+    template<class Reader_>
+    void load(const Reader_& reader, bool memory_map) {
+        reader.load("NUM_OBS", &my_obs, 1);
+        reader.load("NUM_DIM", &my_dim, 1);
         auto num_centers = my_sizes.size();
-        knncolle::quick_load(dir / "NUM_CENTERS", &num_centers, 1);
+        reader.load("NUM_CENTERS", &num_centers, 1);
 
-        my_data.resize(sanisizer::product<I<decltype(my_data.size())> >(sanisizer::attest_gez(my_obs), my_dim));
-        knncolle::quick_load(dir / "DATA", my_data.data(), my_data.size());
+        // Only the large arrays are memory-mapped, as there's no point doing so for the per-cluster arrays.
+        const auto num_data = sanisizer::product<std::size_t>(sanisizer::attest_gez(my_obs), my_dim);
+        reader.load("DATA", my_data, num_data, memory_map);
 
         sanisizer::resize(my_sizes, sanisizer::attest_gez(num_centers));
-        knncolle::quick_load(dir / "SIZES", my_sizes.data(), my_sizes.size());
+        reader.load("SIZES", my_sizes.data(), my_sizes.size());
         sanisizer::resize(my_offsets, sanisizer::attest_gez(num_centers));
-        knncolle::quick_load(dir / "OFFSETS", my_offsets.data(), my_offsets.size());
-        my_centers.resize(sanisizer::product<I<decltype(my_centers.size())> >(my_dim, sanisizer::attest_gez(num_centers)));
-        knncolle::quick_load(dir / "CENTERS", my_centers.data(), my_centers.size());
+        reader.load("OFFSETS", my_offsets.data(), my_offsets.size());
+        reader.load("CENTERS", my_centers, sanisizer::product<std::size_t>(my_dim, sanisizer::attest_gez(num_centers)), memory_map);
+
+        const auto num_obs = sanisizer::cast<std::size_t>(sanisizer::attest_gez(my_obs));
+        reader.load("OBSERVATION_ID", my_observation_id, num_obs, memory_map);
+        reader.load("NEW_LOCATION", my_new_location, num_obs, memory_map);
+        reader.load("DIST_TO_CENTROID", my_dist_to_centroid, num_obs, memory_map);
+        compute_cluster_radii();
+
+        // Optional for back-compatibility with indices saved by older versions.
+        if (reader.has("EARLY_ABANDON")) {
+            reader.load("EARLY_ABANDON", &my_early_abandon_block, 1);
+        }
+        if (reader.has("POWER")) {
+            reader.load("POWER", &my_power, 1);
+        }
+        if (reader.has("DIMENSION_ORDER")) {
+            sanisizer::resize(my_dimension_order, my_dim);
+            reader.load("DIMENSION_ORDER", my_dimension_order.data(), my_dimension_order.size());
+        }
+        if (reader.has("NUM_PIVOTS")) {
+            reader.load("NUM_PIVOTS", &my_num_pivots, 1);
+            my_pivots.resize(sanisizer::product<I<decltype(my_pivots.size())> >(sanisizer::product<std::size_t>(sanisizer::attest_gez(num_centers), my_num_pivots), my_dim));
+            reader.load("PIVOTS", my_pivots.data(), my_pivots.size());
+            reader.load("PIVOT_DISTANCES", my_pivot_distances, sanisizer::product<std::size_t>(num_obs, my_num_pivots), memory_map);
+            set_pivot_tolerance();
+        }
 
-        sanisizer::resize(my_observation_id, sanisizer::attest_gez(my_obs));
-        knncolle::quick_load(dir / "OBSERVATION_ID", my_observation_id.data(), my_observation_id.size());
-        sanisizer::resize(my_new_location, sanisizer::attest_gez(my_obs));
-        knncolle::quick_load(dir / "NEW_LOCATION", my_new_location.data(), my_new_location.size());
-        sanisizer::resize(my_dist_to_centroid, sanisizer::attest_gez(my_obs));
-        knncolle::quick_load(dir / "DIST_TO_CENTROID", my_dist_to_centroid.data(), my_dist_to_centroid.size());
+        // Older versions only saved the results of these settings.
+        my_quantize = reader.has("QUANTIZE") || reader.has("QUANTIZED");
+        my_reorder_dimensions = reader.has("REORDER_DIMENSIONS") || reader.has("DIMENSION_ORDER");
+        if (reader.has("SUPER_CENTER_POWER")) {
+            reader.load("SUPER_CENTER_POWER", &my_super_center_power, 1);
+        }
+        if (reader.has("MAX_CLUSTER_SIZE")) {
+            reader.load("MAX_CLUSTER_SIZE", &my_max_cluster_size, 1);
+        }
+
+        if (reader.has("DELETED")) {
+            sanisizer::resize(my_deleted, num_obs);
+            reader.load("DELETED", my_deleted.data(), my_deleted.size());
+            my_num_deleted = std::count(my_deleted.begin(), my_deleted.end(), 1);
+        }
+
+        if (reader.has("SUPER_OFFSETS")) {
+            std::size_t num_super = 0;
+            reader.load("NUM_SUPER_CENTERS", &num_super, 1);
+            sanisizer::resize(my_super_offsets, sanisizer::sum<std::size_t>(num_super, 1));
+            reader.load("SUPER_OFFSETS", my_super_offsets.data(), my_super_offsets.size());
+            my_super_centers.resize(sanisizer::product<I<decltype(my_super_centers.size())> >(num_super, my_dim));
+            reader.load("SUPER_CENTERS", my_super_centers.data(), my_super_centers.size());
+            sanisizer::resize(my_super_radius, num_super);
+            reader.load("SUPER_RADIUS", my_super_radius.data(), my_super_radius.size());
+        }
+
+        if (reader.has("QUANTIZED")) {
+            reader.load("QUANTIZED", my_quantized, num_data, memory_map);
+            sanisizer::resize(my_quantized_min, my_dim);
+            reader.load("QUANTIZED_MIN", my_quantized_min.data(), my_quantized_min.size());
+            sanisizer::resize(my_quantized_scale, my_dim);
+            reader.load("QUANTIZED_SCALE", my_quantized_scale.data(), my_quantized_scale.size());
+            reader.load("QUANTIZED_ERROR", &my_quantized_error, 1);
+            set_quantized_tolerance();
+        }
 
         {
-            auto dptr = knncolle::load_distance_metric_raw<Data_, Distance_>(dir / "DISTANCE_DATA");
+            auto dptr = reader.template load_distance_metric<Data_, Distance_>("DISTANCE_DATA");
             auto xptr = dynamic_cast<DistanceMetricData_*>(dptr);
             if (xptr == NULL) {
                 throw std::runtime_error("cannot cast the loaded distance metric to a DistanceMetricData_");
@@ -596,13 +2895,29 @@ public:
         }
 
         {
-            auto dptr = knncolle::load_distance_metric_raw<Data_, Distance_>(dir / "DISTANCE_CENTER");
+            auto dptr = reader.template load_distance_metric<Data_, Distance_>("DISTANCE_CENTER");
             auto xptr = dynamic_cast<DistanceMetricCenter_*>(dptr);
             if (xptr == NULL) {
                 throw std::runtime_error("cannot cast the loaded distance metric to a DistanceMetricCenter_");
             }
             my_metric_center.reset(xptr);
         }
+
+        identify_distances();
+
+        my_tiled = reader.has("TILED") && my_data_kind != DistanceKind::OTHER;
+        if (my_tiled) {
+            compute_tiles(1);
+        }
+    }
+
+public:
+    KmknnPrebuilt(const std::filesystem::path& dir, bool memory_map = false) {
+        load(DirectoryReader(dir), memory_map);
+    }
+
+    KmknnPrebuilt(const ContainerReader& reader, bool memory_map = false) {
+        load(reader, memory_map);
     }
 };
 /**
@@ -766,6 +3081,52 @@ public:
     auto build_known_shared(const Matrix_& data) const {
         return std::shared_ptr<I<decltype(*build_known_raw(data))> >(build_known_raw(data));
     }
+
+public:
+    /**
+     * Build an index without holding all observations of `data` in memory, e.g., for datasets that are larger than the available RAM.
+     * This makes three passes through `data` with `knncolle::Matrix::new_known_extractor()`:
+     *
+     * 1. The cluster centers are computed from a random subsample of observations.
+     *    The size of the subsample is defined by `KmknnOptions::kmeans_subsample_size`, or if zero, the number of observations that fit in `KmknnStreamingOptions::buffer_size`.
+     * 2. Each observation is assigned to its closest center.
+     * 3. The observations are written to `dir` in their reordered positions, i.e., cluster by cluster.
+     *    Each chunk of observations that fits in the buffer is written to the file in order of the reordered positions.
+     *
+     * Only the per-observation cluster assignments and distances, the subsample and the buffer are held in memory.
+     * All other index files are also written to `dir`, so the result can be loaded by `load_kmknn_prebuilt()` in the same manner as a directory created by `knncolle::Prebuilt::save()`.
+     *
+     * Tuning with `KmknnOptions::candidate_powers`, `KmknnOptions::max_cluster_size`, `KmknnOptions::super_center_power`, `KmknnOptions::quantize`, `KmknnOptions::reorder_dimensions` and `KmknnOptions::tile_subjects` are not supported and will raise an error.
+     * `KmknnOptions::reorder_in_place` is ignored.
+     *
+     * @param data Matrix of observations.
+     * @param dir Path to an existing directory in which to store the index.
+     * The files in this directory should not be modified while the returned index is in use.
+     * @param stream_options Further options for the streaming build.
+     *
+     * @return Pointer to a prebuilt index, where the reordered data is memory-mapped from `dir`.
+     */
+    auto build_streaming_raw(const Matrix_& data, const std::filesystem::path& dir, const KmknnStreamingOptions& stream_options = KmknnStreamingOptions()) const {
+        return new KmknnPrebuilt<Index_, Data_, Distance_, DistanceMetricData_, KmeansFloat_, DistanceMetricCenter_>(
+            data,
+            dir,
+            my_metric_data,
+            my_metric_center,
+            my_options,
+            stream_options
+        );
+    }
+
+    /**
+     * @param data Matrix of observations.
+     * @param dir Path to an existing directory in which to store the index.
+     * @param stream_options Further options for the streaming build.
+     *
+     * @return Unique pointer to a prebuilt index, see `build_streaming_raw()` for details.
+     */
+    auto build_streaming_unique(const Matrix_& data, const std::filesystem::path& dir, const KmknnStreamingOptions& stream_options = KmknnStreamingOptions()) const {
+        return std::unique_ptr<I<decltype(*build_streaming_raw(data, dir, stream_options))> >(build_streaming_raw(data, dir, stream_options));
+    }
 };
 
 }
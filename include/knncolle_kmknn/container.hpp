@@ -0,0 +1,485 @@
+#ifndef KNNCOLLE_KMKNN_CONTAINER_HPP
+#define KNNCOLLE_KMKNN_CONTAINER_HPP
+
+#include "knncolle/knncolle.hpp"
+#include "store.hpp"
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <random>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+/**
+ * @file container.hpp
+ * @brief Save a prebuilt index into a single file.
+ */
+
+namespace knncolle_kmknn {
+
+/**
+ * @cond
+ */
+// The single-file container consists of:
+//
+// - an 8-byte magic string.
+// - a 32-bit format version and a 32-bit section count.
+// - for each section, a 32-bit name length, the name, and 64-bit offset, size and checksum.
+// - a 64-bit checksum of all preceding bytes in the header.
+// - the contents of each section, where each section starts at a multiple of 'container_alignment' bytes from the start of the file.
+//
+// Each section corresponds to a file that would have been created by save(), named by its relative path in the save() directory.
+// All integers are stored in the native byte order, so like save(), the container is not guaranteed to be portable between machines.
+inline constexpr char container_magic[8] = { 'K', 'M', 'K', 'N', 'N', 'I', 'D', 'X' };
+
+inline constexpr std::uint32_t container_version = 1;
+
+// Aligning each section to a cache line ensures that any array in a memory-mapped container is suitably aligned for its type.
+inline constexpr std::uint64_t container_alignment = 64;
+
+// 64-bit FNV-1a hash, which is simple and fast enough to not be the bottleneck when reading from disk.
+inline constexpr std::uint64_t container_checksum_start = 14695981039346656037ull;
+
+inline std::uint64_t container_checksum(const unsigned char* ptr, std::size_t n, std::uint64_t state = container_checksum_start) {
+    for (std::size_t i = 0; i < n; ++i) {
+        state ^= ptr[i];
+        state *= 1099511628211ull;
+    }
+    return state;
+}
+
+inline std::uint64_t container_align(std::uint64_t position) {
+    const auto remainder = position % container_alignment;
+    return (remainder ? position + (container_alignment - remainder) : position);
+}
+
+struct ContainerSection {
+    std::string name;
+    std::uint64_t offset = 0;
+    std::uint64_t size = 0;
+    std::uint64_t checksum = 0;
+};
+
+// Temporary directory that is removed upon destruction.
+class TemporaryDirectory {
+public:
+    TemporaryDirectory() {
+        const auto base = std::filesystem::temp_directory_path();
+        std::random_device rd;
+        std::mt19937_64 rng(rd());
+        while (true) {
+            my_path = base / ("knncolle_kmknn-" + std::to_string(rng()));
+            if (std::filesystem::create_directory(my_path)) {
+                break;
+            }
+        }
+    }
+
+    ~TemporaryDirectory() {
+        std::error_code ec; // no throwing in the destructor.
+        std::filesystem::remove_all(my_path, ec);
+    }
+
+    TemporaryDirectory(const TemporaryDirectory&) = delete;
+    TemporaryDirectory& operator=(const TemporaryDirectory&) = delete;
+
+private:
+    std::filesystem::path my_path;
+
+public:
+    const std::filesystem::path& path() const {
+        return my_path;
+    }
+};
+
+// Collects the sections of a container and then writes them to file.
+// Arrays are referenced rather than copied, so they should not be modified until write() is called.
+class ContainerWriter {
+private:
+    struct PendingSection {
+        std::string name;
+        const unsigned char* ptr = NULL;
+        std::uint64_t size = 0;
+        std::string contents; // only used for sections read from a directory, see save_directory().
+        bool owned = false;
+
+        const unsigned char* bytes() const {
+            return (owned ? reinterpret_cast<const unsigned char*>(contents.data()) : ptr);
+        }
+    };
+
+    std::vector<PendingSection> my_pending;
+
+public:
+    template<typename Type_>
+    void save(const std::string& name, const Type_* ptr, std::size_t size) {
+        PendingSection current;
+        current.name = name;
+        current.ptr = reinterpret_cast<const unsigned char*>(ptr);
+        current.size = sizeof(Type_) * static_cast<std::uint64_t>(size);
+        my_pending.push_back(std::move(current));
+    }
+
+    // Scalars are copied as they are typically temporaries.
+    template<typename Type_>
+    void save_value(const std::string& name, const Type_& value) {
+        PendingSection current;
+        current.name = name;
+        current.contents.assign(reinterpret_cast<const char*>(&value), sizeof(Type_));
+        current.size = sizeof(Type_);
+        current.owned = true;
+        my_pending.push_back(std::move(current));
+    }
+
+    // For files created by functions that can only write to a directory, e.g., knncolle::DistanceMetric::save().
+    // These files are small so we just hold their contents in memory until write() is called.
+    template<class Function_>
+    void save_directory(const std::string& prefix, Function_ fun) {
+        TemporaryDirectory tmp;
+        fun(tmp.path());
+        for (const auto& entry : std::filesystem::recursive_directory_iterator(tmp.path())) {
+            if (entry.is_regular_file()) {
+                PendingSection current;
+                const auto relative = std::filesystem::relative(entry.path(), tmp.path()).generic_string();
+                current.name = (prefix.empty() ? relative : prefix + "/" + relative);
+                current.contents = knncolle::quick_load_as_string(entry.path());
+                current.size = current.contents.size();
+                current.owned = true;
+                my_pending.push_back(std::move(current));
+            }
+        }
+    }
+
+    void write(const std::filesystem::path& path) {
+        std::sort(my_pending.begin(), my_pending.end(), [](const PendingSection& left, const PendingSection& right) -> bool { return left.name < right.name; });
+
+        // Computing the offsets, which requires us to know the header size first.
+        std::uint64_t header_size = sizeof(container_magic) + sizeof(std::uint32_t) * 2 + sizeof(std::uint64_t);
+        for (const auto& pending : my_pending) {
+            header_size += sizeof(std::uint32_t) + pending.name.size() + sizeof(std::uint64_t) * 3;
+        }
+
+        std::vector<ContainerSection> sections(my_pending.size());
+        std::uint64_t position = container_align(header_size);
+        for (std::size_t s = 0; s < sections.size(); ++s) {
+            auto& sec = sections[s];
+            const auto& pending = my_pending[s];
+            sec.name = pending.name;
+            sec.offset = position;
+            sec.size = pending.size;
+            sec.checksum = container_checksum(pending.bytes(), pending.size);
+            position = container_align(position + sec.size);
+        }
+
+        std::string header(container_magic, sizeof(container_magic));
+        auto append = [&](const auto& value) -> void {
+            header.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        };
+        append(container_version);
+        append(static_cast<std::uint32_t>(sections.size()));
+        for (const auto& sec : sections) {
+            append(static_cast<std::uint32_t>(sec.name.size()));
+            header += sec.name;
+            append(sec.offset);
+            append(sec.size);
+            append(sec.checksum);
+        }
+        append(container_checksum(reinterpret_cast<const unsigned char*>(header.data()), header.size()));
+
+        // Writing to a temporary file first, so that readers never see a partially written container at 'path'.
+        auto tmp_path = path;
+        tmp_path += ".tmp";
+
+        {
+            std::ofstream output(tmp_path, std::ios::binary);
+            if (!output) {
+                throw std::runtime_error("failed to open '" + tmp_path.string() + "' for writing");
+            }
+
+            const char padding[container_alignment] = {};
+            output.write(header.data(), header.size());
+            std::uint64_t written = header.size();
+            for (std::size_t s = 0; s < sections.size(); ++s) {
+                const auto& sec = sections[s];
+                output.write(padding, sec.offset - written); // padding is always smaller than the alignment.
+                output.write(reinterpret_cast<const char*>(my_pending[s].bytes()), sec.size);
+                written = sec.offset + sec.size;
+            }
+
+            output.close();
+            if (!output) {
+                throw std::runtime_error("failed to write '" + tmp_path.string() + "'");
+            }
+        }
+
+        std::filesystem::rename(tmp_path, path);
+    }
+};
+
+// Implemented by prebuilt indices that can save their arrays directly into a ContainerWriter, without first saving them to a directory.
+class ContainerSaveable {
+public:
+    virtual ~ContainerSaveable() = default;
+    virtual void save_sections(ContainerWriter& writer) const = 0;
+};
+
+// Read-only access to the sections of a container, via a memory mapping of the entire file.
+class ContainerReader {
+public:
+    ContainerReader(const std::filesystem::path& path, bool verify_checksums) : my_path(path), my_file(std::make_shared<const MappedFile>(path)) {
+        const auto start = static_cast<const unsigned char*>(my_file->data());
+        const std::size_t total = my_file->size();
+        std::size_t position = 0;
+
+        auto extract = [&](auto& value) -> void {
+            if (total - position < sizeof(value)) {
+                throw std::runtime_error("truncated header in '" + my_path.string() + "'");
+            }
+            std::memcpy(&value, start + position, sizeof(value));
+            position += sizeof(value);
+        };
+
+        char magic[sizeof(container_magic)];
+        extract(magic);
+        if (std::memcmp(magic, container_magic, sizeof(container_magic)) != 0) {
+            throw std::runtime_error("'" + my_path.string() + "' is not a KMKNN index file");
+        }
+
+        std::uint32_t version;
+        extract(version);
+        if (version != container_version) {
+            throw std::runtime_error("unsupported version " + std::to_string(version) + " for the KMKNN index file '" + my_path.string() + "'");
+        }
+
+        // Checking that the number of sections is plausible before allocating anything, given that each section takes up a minimum number of bytes in the header.
+        std::uint32_t num_sections;
+        extract(num_sections);
+        constexpr std::size_t min_section_bytes = sizeof(std::uint32_t) + sizeof(std::uint64_t) * 3;
+        if (total - position < sizeof(std::uint64_t) || (total - position - sizeof(std::uint64_t)) / min_section_bytes < num_sections) {
+            throw std::runtime_error("truncated header in '" + my_path.string() + "'");
+        }
+        my_sections.resize(num_sections);
+        for (auto& sec : my_sections) {
+            std::uint32_t len;
+            extract(len);
+            if (total - position < len) {
+                throw std::runtime_error("truncated header in '" + my_path.string() + "'");
+            }
+            sec.name.insert(sec.name.end(), start + position, start + position + len);
+            position += len;
+            extract(sec.offset);
+            extract(sec.size);
+            extract(sec.checksum);
+        }
+
+        const auto expected = container_checksum(start, position);
+        std::uint64_t observed;
+        extract(observed);
+        if (expected != observed) {
+            throw std::runtime_error("checksum mismatch for the header of '" + my_path.string() + "'");
+        }
+
+        for (const auto& sec : my_sections) {
+            if (sec.offset > total || total - sec.offset < sec.size) {
+                throw std::runtime_error("section '" + sec.name + "' extends past the end of '" + my_path.string() + "'");
+            }
+        }
+
+        if (verify_checksums) {
+            for (const auto& sec : my_sections) {
+                if (container_checksum(start + sec.offset, sec.size) != sec.checksum) {
+                    throw std::runtime_error("checksum mismatch for section '" + sec.name + "' of '" + my_path.string() + "'");
+                }
+            }
+        }
+    }
+
+private:
+    std::filesystem::path my_path;
+    std::shared_ptr<const MappedFile> my_file;
+    std::vector<ContainerSection> my_sections;
+
+    const ContainerSection* find(const std::string& name) const {
+        for (const auto& sec : my_sections) {
+            if (sec.name == name) {
+                return &sec;
+            }
+        }
+        return NULL;
+    }
+
+    template<typename Type_>
+    const Type_* get(const std::string& name, std::size_t size) const {
+        auto sec = find(name);
+        if (sec == NULL) {
+            throw std::runtime_error("missing section '" + name + "' in '" + my_path.string() + "'");
+        }
+        if (sec->size / sizeof(Type_) < size) {
+            throw std::runtime_error("section '" + name + "' in '" + my_path.string() + "' is too small for the requested number of elements");
+        }
+        return reinterpret_cast<const Type_*>(static_cast<const unsigned char*>(my_file->data()) + sec->offset);
+    }
+
+public:
+    const std::vector<ContainerSection>& sections() const {
+        return my_sections;
+    }
+
+    bool has(const std::string& name) const {
+        return find(name) != NULL;
+    }
+
+    std::string load_as_string(const std::string& name) const {
+        auto ptr = get<char>(name, 0);
+        return std::string(ptr, ptr + find(name)->size);
+    }
+
+    template<typename Type_>
+    void load(const std::string& name, Type_* output, std::size_t size) const {
+        auto ptr = get<Type_>(name, size);
+        std::copy_n(ptr, size, output);
+    }
+
+    template<typename Type_>
+    void load(const std::string& name, ArrayStore<Type_>& store, std::size_t size, bool memory_map) const {
+        auto ptr = get<Type_>(name, size);
+        if (memory_map) {
+            store.map(my_file, ptr, size);
+        } else {
+            store.resize(size);
+            std::copy_n(ptr, size, store.data());
+        }
+    }
+
+    template<typename Data_, typename Distance_>
+    knncolle::DistanceMetric<Data_, Distance_>* load_distance_metric(const std::string& name) const {
+        // The loading functions expect a directory that they are free to read, so the metric's sections are always extracted to a real one.
+        if (!has(name + "/DISTANCE")) {
+            throw std::runtime_error("no distance metric '" + name + "' in '" + my_path.string() + "'");
+        }
+        TemporaryDirectory tmp;
+        extract(name, tmp.path());
+        return knncolle::load_distance_metric_raw<Data_, Distance_>(tmp.path());
+    }
+
+    // Writes all sections under the 'prefix' subdirectory into 'dir', e.g., for use with loading functions that expect a directory.
+    void extract(const std::string& prefix, const std::filesystem::path& dir) const {
+        const std::string full_prefix = prefix + "/";
+        const auto start = static_cast<const unsigned char*>(my_file->data());
+        for (const auto& sec : my_sections) {
+            if (sec.name.compare(0, full_prefix.size(), full_prefix) != 0) {
+                continue;
+            }
+            const auto target = dir / sec.name.substr(full_prefix.size());
+            std::filesystem::create_directories(target.parent_path());
+            knncolle::quick_save(target, reinterpret_cast<const char*>(start + sec.offset), sec.size);
+        }
+    }
+};
+
+// Reading the files of a save() directory, with the same interface as the ContainerReader.
+class DirectoryReader {
+public:
+    DirectoryReader(std::filesystem::path dir) : my_dir(std::move(dir)) {}
+
+private:
+    std::filesystem::path my_dir;
+
+public:
+    bool has(const std::string& name) const {
+        return std::filesystem::exists(my_dir / name);
+    }
+
+    template<typename Type_>
+    void load(const std::string& name, Type_* output, std::size_t size) const {
+        knncolle::quick_load(my_dir / name, output, size);
+    }
+
+    template<typename Type_>
+    void load(const std::string& name, ArrayStore<Type_>& store, std::size_t size, bool memory_map) const {
+        if (memory_map) {
+            store.map(my_dir / name, size);
+        } else {
+            store.resize(size);
+            knncolle::quick_load(my_dir / name, store.data(), store.size());
+        }
+    }
+
+    template<typename Data_, typename Distance_>
+    knncolle::DistanceMetric<Data_, Distance_>* load_distance_metric(const std::string& name) const {
+        return knncolle::load_distance_metric_raw<Data_, Distance_>(my_dir / name);
+    }
+};
+
+// Writing the files of a save() directory, with the same interface as the ContainerWriter.
+class DirectoryWriter {
+public:
+    DirectoryWriter(std::filesystem::path dir) : my_dir(std::move(dir)) {}
+
+private:
+    std::filesystem::path my_dir;
+
+public:
+    template<typename Type_>
+    void save(const std::string& name, const Type_* ptr, std::size_t size) {
+        knncolle::quick_save(my_dir / name, ptr, size);
+    }
+
+    template<typename Type_>
+    void save_value(const std::string& name, const Type_& value) {
+        knncolle::quick_save(my_dir / name, &value, 1);
+    }
+
+    template<class Function_>
+    void save_directory(const std::string& prefix, Function_ fun) {
+        if (prefix.empty()) {
+            fun(my_dir);
+        } else {
+            const auto subdir = my_dir / prefix;
+            std::filesystem::create_directory(subdir);
+            fun(subdir);
+        }
+    }
+};
+/**
+ * @endcond
+ */
+
+/**
+ * Save a prebuilt index into a single file, as an alternative to the directory of files created by `knncolle::Prebuilt::save()`.
+ * The file contains a header with a format version and the offset, size and checksum of each section,
+ * where each section contains the contents of one of the files that would have been created by `knncolle::Prebuilt::save()`.
+ * Sections are aligned so that the saved arrays can be memory-mapped by `load_kmknn_prebuilt_file()`.
+ *
+ * For KMKNN indices, the arrays are written directly from memory (or from the memory mapping of a loaded index) into the file.
+ * The file is first written to a temporary path and then renamed to `path`, so other processes will never observe a partially written file.
+ * Like `knncolle::Prebuilt::save()`, the file is not guaranteed to be portable between machines.
+ *
+ * @tparam Index_ Integer type for the observation indices.
+ * @tparam Data_ Numeric type for the input and query data.
+ * @tparam Distance_ Floating-point type for the distances.
+ *
+ * @param prebuilt A prebuilt KMKNN index.
+ * @param path Path to the output file.
+ */
+template<typename Index_, typename Data_, typename Distance_>
+void save_kmknn_prebuilt_file(const knncolle::Prebuilt<Index_, Data_, Distance_>& prebuilt, const std::filesystem::path& path) {
+    ContainerWriter writer;
+    auto saveable = dynamic_cast<const ContainerSaveable*>(&prebuilt);
+    if (saveable) {
+        saveable->save_sections(writer);
+    } else {
+        writer.save_directory("", [&](const std::filesystem::path& dir) -> void { prebuilt.save(dir); });
+    }
+    writer.write(path);
+}
+
+}
+
+#endif
@@ -0,0 +1,166 @@
+#ifndef KNNCOLLE_KMKNN_CONVERT_HPP
+#define KNNCOLLE_KMKNN_CONVERT_HPP
+
+#include "utils.hpp"
+
+#include "kmeans/kmeans.hpp"
+#include "sanisizer/sanisizer.hpp"
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstddef>
+
+/**
+ * @file convert.hpp
+ * @brief Conversion of the data for k-means clustering.
+ */
+
+namespace knncolle_kmknn {
+
+/**
+ * @cond
+ */
+// kmeans::Matrix that converts the observations of a row-major 'Data_' array to 'KmeansData_' upon extraction.
+// This avoids materializing a converted copy of the entire dataset when 'Data_' and 'KmeansData_' are different.
+template<typename Index_, typename Data_, typename KmeansData_>
+class ConvertedMatrix final : public kmeans::Matrix<Index_, KmeansData_> {
+public:
+    ConvertedMatrix(std::size_t num_dim, Index_ num_obs, const Data_* data) : my_dim(num_dim), my_obs(num_obs), my_data(data) {}
+
+private:
+    std::size_t my_dim;
+    Index_ my_obs;
+    const Data_* my_data;
+
+    // Consecutive and indexed extractors convert blocks of observations to amortize the cost of each virtual call.
+    // The block size is chosen so that each buffer occupies roughly 64 kB.
+    Index_ block_size(Index_ length) const {
+        const std::size_t per_block = std::max<std::size_t>(1, 65536 / (sizeof(KmeansData_) * std::max<std::size_t>(my_dim, 1)));
+        return (per_block < static_cast<std::size_t>(length) ? static_cast<Index_>(per_block) : length);
+    }
+
+    const Data_* source(Index_ i) const {
+        return my_data + sanisizer::product_unsafe<std::size_t>(i, my_dim);
+    }
+
+public:
+    Index_ num_observations() const {
+        return my_obs;
+    }
+
+    std::size_t num_dimensions() const {
+        return my_dim;
+    }
+
+public:
+    class RandomAccess final : public kmeans::RandomAccessExtractor<Index_, KmeansData_> {
+    public:
+        RandomAccess(const ConvertedMatrix& parent) : my_parent(parent), my_buffer(sanisizer::cast<I<decltype(my_buffer.size())> >(parent.my_dim)) {}
+
+    private:
+        const ConvertedMatrix& my_parent;
+        std::vector<KmeansData_> my_buffer;
+
+    public:
+        const KmeansData_* get_observation(Index_ i) {
+            std::copy_n(my_parent.source(i), my_parent.my_dim, my_buffer.data());
+            return my_buffer.data();
+        }
+    };
+
+    class ConsecutiveAccess final : public kmeans::ConsecutiveAccessExtractor<Index_, KmeansData_> {
+    public:
+        ConsecutiveAccess(const ConvertedMatrix& parent, Index_ start, Index_ length) :
+            my_parent(parent),
+            my_next(start),
+            my_remaining(length),
+            my_block(parent.block_size(length)),
+            my_buffer(sanisizer::product<I<decltype(my_buffer.size())> >(sanisizer::attest_gez(my_block), parent.my_dim))
+        {}
+
+    private:
+        const ConvertedMatrix& my_parent;
+        Index_ my_next, my_remaining, my_block;
+        std::vector<KmeansData_> my_buffer;
+        Index_ my_used = 0, my_filled = 0;
+
+    public:
+        const KmeansData_* get_observation() {
+            if (my_used == my_filled) {
+                // Consecutive observations are contiguous in the source array, so the entire block can be converted at once.
+                my_filled = std::min(my_block, my_remaining);
+                std::copy_n(my_parent.source(my_next), sanisizer::product_unsafe<std::size_t>(my_filled, my_parent.my_dim), my_buffer.data());
+                my_next += my_filled;
+                my_remaining -= my_filled;
+                my_used = 0;
+            }
+            return my_buffer.data() + sanisizer::product_unsafe<std::size_t>(my_used++, my_parent.my_dim);
+        }
+    };
+
+    class IndexedAccess final : public kmeans::IndexedAccessExtractor<Index_, KmeansData_> {
+    public:
+        IndexedAccess(const ConvertedMatrix& parent, const Index_* sequence, std::size_t length) :
+            my_parent(parent),
+            my_sequence(sequence),
+            my_remaining(length),
+            my_block(parent.block_size(sanisizer::cast<Index_>(std::min<std::size_t>(length, parent.my_obs)))),
+            my_buffer(sanisizer::product<I<decltype(my_buffer.size())> >(sanisizer::attest_gez(my_block), parent.my_dim))
+        {}
+
+    private:
+        const ConvertedMatrix& my_parent;
+        const Index_* my_sequence;
+        std::size_t my_remaining;
+        Index_ my_block;
+        std::vector<KmeansData_> my_buffer;
+        Index_ my_used = 0, my_filled = 0;
+
+    public:
+        const KmeansData_* get_observation() {
+            if (my_used == my_filled) {
+                my_filled = (static_cast<std::size_t>(my_block) < my_remaining ? my_block : static_cast<Index_>(my_remaining));
+                for (Index_ b = 0; b < my_filled; ++b) {
+                    std::copy_n(my_parent.source(my_sequence[b]), my_parent.my_dim, my_buffer.data() + sanisizer::product_unsafe<std::size_t>(b, my_parent.my_dim));
+                }
+                my_sequence += my_filled;
+                my_remaining -= my_filled;
+                my_used = 0;
+            }
+            return my_buffer.data() + sanisizer::product_unsafe<std::size_t>(my_used++, my_parent.my_dim);
+        }
+    };
+
+public:
+    auto new_known_extractor() const {
+        return std::make_unique<RandomAccess>(*this);
+    }
+
+    auto new_known_extractor(Index_ start, Index_ length) const {
+        return std::make_unique<ConsecutiveAccess>(*this, start, length);
+    }
+
+    auto new_known_extractor(const Index_* sequence, std::size_t length) const {
+        return std::make_unique<IndexedAccess>(*this, sequence, length);
+    }
+
+    std::unique_ptr<kmeans::RandomAccessExtractor<Index_, KmeansData_> > new_extractor() const {
+        return new_known_extractor();
+    }
+
+    std::unique_ptr<kmeans::ConsecutiveAccessExtractor<Index_, KmeansData_> > new_extractor(Index_ start, Index_ length) const {
+        return new_known_extractor(start, length);
+    }
+
+    std::unique_ptr<kmeans::IndexedAccessExtractor<Index_, KmeansData_> > new_extractor(const Index_* sequence, std::size_t length) const {
+        return new_known_extractor(sequence, length);
+    }
+};
+/**
+ * @endcond
+ */
+
+}
+
+#endif
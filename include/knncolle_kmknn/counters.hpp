@@ -0,0 +1,109 @@
+#ifndef KNNCOLLE_KMKNN_COUNTERS_HPP
+#define KNNCOLLE_KMKNN_COUNTERS_HPP
+
+#include <cstddef>
+
+/**
+ * @file counters.hpp
+ * @brief Instrumentation counters for the KMKNN search.
+ */
+
+namespace knncolle_kmknn {
+
+/**
+ * Whether the search counters in `KmknnSearchCounters` are updated.
+ * This is only true if the `KNNCOLLE_KMKNN_COUNTERS` macro is defined before including any **knncolle_kmknn** headers.
+ * By default, the counters are disabled so that they have no effect on the search performance.
+ *
+ * Note that the macro should be consistently defined (or not) across all translation units of the same program.
+ */
+#ifdef KNNCOLLE_KMKNN_COUNTERS
+constexpr bool search_counters_enabled = true;
+#else
+constexpr bool search_counters_enabled = false;
+#endif
+
+/**
+ * @brief Counters for the work performed by a KMKNN searcher.
+ *
+ * These counters describe the effectiveness of the pruning in the KMKNN search, e.g., to choose an appropriate `KmknnOptions::power`.
+ * They are accumulated across all calls to a single searcher's methods and can be retrieved with `KmknnSearcher::get_counters()`.
+ * Counters from multiple searchers (e.g., in different threads) can be aggregated with `+=`.
+ *
+ * All counters remain at zero unless `search_counters_enabled` is true.
+ */
+struct KmknnSearchCounters {
+    /**
+     * Number of query-to-center distances that were computed.
+     */
+    std::size_t centers_evaluated = 0;
+
+    /**
+     * Number of query-to-super-center distances that were computed.
+     * This is always zero if `KmknnOptions::super_center_power = 0`.
+     */
+    std::size_t super_centers_evaluated = 0;
+
+    /**
+     * Number of clusters that were skipped as the query-to-center distance minus the threshold is greater than the cluster radius,
+     * i.e., by the lower bound of the triangle inequality.
+     * This includes clusters that are skipped by the early termination of the search once all remaining clusters are too far away.
+     */
+    std::size_t centers_skipped = 0;
+
+    /**
+     * Number of clusters that were skipped as the query-to-center distance plus the threshold is less than the smallest distance from the center to any of its subjects,
+     * i.e., the query lies inside the inner radius of the cluster.
+     */
+    std::size_t annulus_skipped = 0;
+
+    /**
+     * Number of subjects in the trimmed range of each searched cluster.
+     * This is the number of subjects for which the query-to-subject distance was considered, possibly after filtering with pivots, quantized coordinates or early abandonment.
+     */
+    std::size_t subjects_scanned = 0;
+
+    /**
+     * Number of scanned subjects that were skipped by the triangle inequality on their distances to the pivots of their cluster,
+     * without computing the full query-to-subject distance.
+     * This is always zero if `KmknnOptions::num_pivots = 0`.
+     */
+    std::size_t pivot_skipped = 0;
+
+    /**
+     * Number of subjects that were added to the queue of nearest neighbors,
+     * or for `knncolle::Searcher::search_all()`, the number of subjects within the threshold.
+     */
+    std::size_t queue_additions = 0;
+
+    /**
+     * Number of times that the distance threshold was decreased after finding a closer neighbor.
+     */
+    std::size_t threshold_tightenings = 0;
+
+    /**
+     * Number of binary searches that were performed to trim the range of subjects in each cluster.
+     */
+    std::size_t binary_search_trims = 0;
+
+    /**
+     * @param other Counters to be added to this object.
+     * @return Reference to this object, after adding `other`.
+     */
+    KmknnSearchCounters& operator+=(const KmknnSearchCounters& other) {
+        centers_evaluated += other.centers_evaluated;
+        super_centers_evaluated += other.super_centers_evaluated;
+        centers_skipped += other.centers_skipped;
+        annulus_skipped += other.annulus_skipped;
+        subjects_scanned += other.subjects_scanned;
+        pivot_skipped += other.pivot_skipped;
+        queue_additions += other.queue_additions;
+        threshold_tightenings += other.threshold_tightenings;
+        binary_search_trims += other.binary_search_trims;
+        return *this;
+    }
+};
+
+}
+
+#endif
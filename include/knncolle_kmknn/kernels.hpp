@@ -0,0 +1,270 @@
+#ifndef KNNCOLLE_KMKNN_KERNELS_HPP
+#define KNNCOLLE_KMKNN_KERNELS_HPP
+
+#include "knncolle/knncolle.hpp"
+
+#include <cstddef>
+#include <cmath>
+#include <array>
+#include <algorithm>
+#include <new>
+
+/**
+ * @file kernels.hpp
+ * @brief Specialized distance kernels for the KMKNN search.
+ */
+
+/**
+ * Width of the SIMD registers in bytes.
+ * This is used to decide how many subjects should be processed in each call to the blocked distance kernels,
+ * so that the per-subject accumulators of each block fill one register.
+ * If not defined, it is automatically set to the widest register that is available on the target architecture.
+ */
+#ifndef KNNCOLLE_KMKNN_SIMD_BYTES
+#if defined(__AVX512F__)
+#define KNNCOLLE_KMKNN_SIMD_BYTES 64
+#elif defined(__AVX__)
+#define KNNCOLLE_KMKNN_SIMD_BYTES 32
+#else
+#define KNNCOLLE_KMKNN_SIMD_BYTES 16
+#endif
+#endif
+
+namespace knncolle_kmknn {
+
+/**
+ * @cond
+ */
+enum class DistanceKind : unsigned char { OTHER, EUCLIDEAN, MANHATTAN };
+
+template<typename Data_, typename Distance_, class DistanceMetric_>
+DistanceKind identify_distance(const DistanceMetric_* metric) {
+    // Going through the base class to avoid any complaints about casts between unrelated final classes.
+    const knncolle::DistanceMetric<Data_, Distance_>* base = metric;
+    if (dynamic_cast<const knncolle::EuclideanDistance<Data_, Distance_>*>(base) != NULL) {
+        return DistanceKind::EUCLIDEAN;
+    } else if (dynamic_cast<const knncolle::ManhattanDistance<Data_, Distance_>*>(base) != NULL) {
+        return DistanceKind::MANHATTAN;
+    } else {
+        return DistanceKind::OTHER;
+    }
+}
+
+// The blocked kernels are portable scalar code without any intrinsics.
+// Each call processes a block of subjects with one accumulator per subject, and each subject's distance is accumulated in dimension order.
+// This ensures that we get exactly the same results as the raw() method of the stock knncolle metrics, which also sum over dimensions in order.
+// The independent accumulators allow instruction-level parallelism, and the compiler is free to vectorize across subjects where it can.
+// We process at least 4 subjects per call to allow some instruction-level parallelism even in the absence of SIMD.
+template<typename Distance_>
+constexpr std::size_t kernel_block_size() {
+    constexpr std::size_t lanes = KNNCOLLE_KMKNN_SIMD_BYTES / sizeof(Distance_);
+    return (lanes < 4 ? 4 : lanes);
+}
+
+struct SquaredDifference {
+    template<typename Distance_>
+    static Distance_ compute(Distance_ x, Distance_ y) {
+        Distance_ delta = x - y;
+        return delta * delta;
+    }
+};
+
+struct AbsoluteDifference {
+    template<typename Distance_>
+    static Distance_ compute(Distance_ x, Distance_ y) {
+        return std::abs(x - y);
+    }
+};
+
+// Blocked kernel for row-major subjects.
+// Each dimension is loaded from subjects that are 'num_dim' elements apart, so any vectorization requires strided loads;
+// use 'tiled_distance_kernel()' for contiguous loads across subjects.
+template<std::size_t block_, class Operation_, typename Data_, typename Distance_>
+void blocked_distance_kernel(std::size_t num_dim, const Data_* query, const Data_* subjects, Distance_* output) {
+    std::array<Distance_, block_> accumulated;
+    std::fill(accumulated.begin(), accumulated.end(), 0);
+    for (std::size_t d = 0; d < num_dim; ++d) {
+        const Distance_ qval = query[d];
+        for (std::size_t b = 0; b < block_; ++b) {
+            accumulated[b] += Operation_::compute(qval, static_cast<Distance_>(subjects[b * num_dim + d]));
+        }
+    }
+    std::copy(accumulated.begin(), accumulated.end(), output);
+}
+
+template<class Operation_, typename Data_, typename Distance_>
+void blocked_distance_kernel_dispatch(std::size_t num_dim, const Data_* query, const Data_* subjects, std::size_t num_subjects, Distance_* output) {
+    constexpr std::size_t block = kernel_block_size<Distance_>();
+    std::size_t s = 0;
+    for (; s + block <= num_subjects; s += block) {
+        blocked_distance_kernel<block, Operation_>(num_dim, query, subjects + s * num_dim, output + s);
+    }
+    for (; s < num_subjects; ++s) {
+        blocked_distance_kernel<1, Operation_>(num_dim, query, subjects + s * num_dim, output + s);
+    }
+}
+
+// Computes raw distances from 'query' to each of the 'num_subjects' contiguous row-major subjects.
+template<typename Data_, typename Distance_, class DistanceMetric_>
+void compute_raw_distances(
+    DistanceKind kind,
+    const DistanceMetric_& metric,
+    std::size_t num_dim,
+    const Data_* query,
+    const Data_* subjects,
+    std::size_t num_subjects,
+    Distance_* output)
+{
+    switch (kind) {
+        case DistanceKind::EUCLIDEAN:
+            blocked_distance_kernel_dispatch<SquaredDifference>(num_dim, query, subjects, num_subjects, output);
+            break;
+        case DistanceKind::MANHATTAN:
+            blocked_distance_kernel_dispatch<AbsoluteDifference>(num_dim, query, subjects, num_subjects, output);
+            break;
+        default:
+            for (std::size_t s = 0; s < num_subjects; ++s) {
+                output[s] = metric.raw(num_dim, query, subjects + s * num_dim);
+            }
+    }
+}
+
+// Tiles of subjects are aligned to cache lines, which is also sufficient for aligned loads into any SIMD register.
+inline constexpr std::size_t tile_alignment = 64;
+
+template<typename Type_>
+class AlignedAllocator {
+public:
+    typedef Type_ value_type;
+
+    AlignedAllocator() = default;
+
+    template<typename Other_>
+    AlignedAllocator(const AlignedAllocator<Other_>&) {}
+
+    Type_* allocate(std::size_t n) {
+        return static_cast<Type_*>(::operator new(n * sizeof(Type_), std::align_val_t(tile_alignment)));
+    }
+
+    void deallocate(Type_* ptr, std::size_t) {
+        ::operator delete(ptr, std::align_val_t(tile_alignment));
+    }
+
+    template<typename Other_>
+    bool operator==(const AlignedAllocator<Other_>&) const {
+        return true;
+    }
+
+    template<typename Other_>
+    bool operator!=(const AlignedAllocator<Other_>&) const {
+        return false;
+    }
+};
+
+// Number of elements in each tile of 'kernel_block_size()' subjects, padded so that consecutive tiles start on a 'tile_alignment' boundary.
+template<typename Data_, typename Distance_>
+std::size_t tile_stride(std::size_t num_dim) {
+    const std::size_t contents = num_dim * kernel_block_size<Distance_>();
+    if constexpr(tile_alignment % sizeof(Data_) == 0) {
+        constexpr std::size_t per_line = tile_alignment / sizeof(Data_);
+        return (contents + per_line - 1) / per_line * per_line;
+    } else {
+        return contents;
+    }
+}
+
+// Same as 'blocked_distance_kernel()' but for a tile of subjects, where the 'd'-th dimension of the 'b'-th subject is stored at 'tile[d * block_ + b]'.
+// Each dimension of the tile is loaded contiguously across subjects, while each subject's distance is still accumulated in dimension order.
+template<std::size_t block_, class Operation_, typename Data_, typename Distance_>
+void tiled_distance_kernel(std::size_t num_dim, const Data_* query, const Data_* tile, Distance_* output) {
+    std::array<Distance_, block_> accumulated;
+    std::fill(accumulated.begin(), accumulated.end(), 0);
+    for (std::size_t d = 0; d < num_dim; ++d) {
+        const Distance_ qval = query[d];
+        const Data_* row = tile + d * block_;
+        for (std::size_t b = 0; b < block_; ++b) {
+            accumulated[b] += Operation_::compute(qval, static_cast<Distance_>(row[b]));
+        }
+    }
+    std::copy(accumulated.begin(), accumulated.end(), output);
+}
+
+// Computes raw distances from 'query' to each of the 'kernel_block_size()' subjects in 'tile'.
+// This should only be called for the stock metrics.
+template<typename Data_, typename Distance_>
+void compute_tiled_raw_distances(DistanceKind kind, std::size_t num_dim, const Data_* query, const Data_* tile, Distance_* output) {
+    constexpr std::size_t block = kernel_block_size<Distance_>();
+    if (kind == DistanceKind::EUCLIDEAN) {
+        tiled_distance_kernel<block, SquaredDifference>(num_dim, query, tile, output);
+    } else {
+        tiled_distance_kernel<block, AbsoluteDifference>(num_dim, query, tile, output);
+    }
+}
+
+// Computes the raw distance from 'query' to 'subject', checking the partial sum against 'threshold' after every 'block' dimensions.
+// If the partial sum exceeds the threshold, we return early as the full distance must also be greater than the threshold;
+// this relies on all of the per-dimension contributions being non-negative, which is true for the stock metrics.
+// Otherwise, the returned distance is exactly the same as that from raw() as the dimensions are accumulated in the same order.
+template<class Operation_, typename Data_, typename Distance_>
+Distance_ distance_kernel_early_abandon(std::size_t num_dim, const Data_* query, const Data_* subject, std::size_t block, Distance_ threshold) {
+    Distance_ accumulated = 0;
+    std::size_t d = 0;
+    while (d < num_dim) {
+        const std::size_t end = d + std::min(block, num_dim - d);
+        for (; d < end; ++d) {
+            accumulated += Operation_::compute(static_cast<Distance_>(query[d]), static_cast<Distance_>(subject[d]));
+        }
+        if (accumulated > threshold) {
+            break;
+        }
+    }
+    return accumulated;
+}
+
+template<typename Data_, typename Distance_, class DistanceMetric_>
+Distance_ compute_raw_distance_early_abandon(
+    DistanceKind kind,
+    const DistanceMetric_& metric,
+    std::size_t num_dim,
+    const Data_* query,
+    const Data_* subject,
+    std::size_t block,
+    Distance_ threshold)
+{
+    switch (kind) {
+        case DistanceKind::EUCLIDEAN:
+            return distance_kernel_early_abandon<SquaredDifference>(num_dim, query, subject, block, threshold);
+        case DistanceKind::MANHATTAN:
+            return distance_kernel_early_abandon<AbsoluteDifference>(num_dim, query, subject, block, threshold);
+        default:
+            return metric.raw(num_dim, query, subject);
+    }
+}
+
+// Computes the raw distance between a query and a scalar-quantized subject.
+// 'shifted_query' should contain the query coordinates after subtracting the per-dimension minimum used for quantization,
+// while 'scale' contains the per-dimension quantization step size.
+template<class Operation_, typename Distance_>
+Distance_ quantized_distance_kernel(std::size_t num_dim, const Distance_* shifted_query, const unsigned char* codes, const Distance_* scale) {
+    Distance_ accumulated = 0;
+    for (std::size_t d = 0; d < num_dim; ++d) {
+        accumulated += Operation_::compute(shifted_query[d], static_cast<Distance_>(codes[d]) * scale[d]);
+    }
+    return accumulated;
+}
+
+template<typename Distance_>
+Distance_ compute_quantized_raw_distance(DistanceKind kind, std::size_t num_dim, const Distance_* shifted_query, const unsigned char* codes, const Distance_* scale) {
+    if (kind == DistanceKind::EUCLIDEAN) {
+        return quantized_distance_kernel<SquaredDifference>(num_dim, shifted_query, codes, scale);
+    } else {
+        return quantized_distance_kernel<AbsoluteDifference>(num_dim, shifted_query, codes, scale);
+    }
+}
+/**
+ * @endcond
+ */
+
+}
+
+#endif
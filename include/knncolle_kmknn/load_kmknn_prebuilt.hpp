@@ -24,6 +24,28 @@ struct KmknnPrebuiltTypes {
     knncolle::NumericType kmeansfloat;
 };
 
+/**
+ * @brief Options for `load_kmknn_prebuilt()`.
+ */
+struct KmknnLoadOptions {
+    /**
+     * Whether to memory-map the large arrays of the saved index (i.e., the data, centers and per-observation arrays) instead of reading them into memory.
+     * This allows the index to be loaded almost instantly, and multiple processes loading the same index will share the same pages in the operating system's page cache.
+     * The files in the saved directory should not be modified while the loaded index is in use.
+     *
+     * If memory mapping is not supported on the current platform, the arrays are read into memory instead.
+     */
+    bool memory_map = false;
+
+    /**
+     * Whether to verify the checksum of each section in `load_kmknn_prebuilt_file()`.
+     * This requires a full pass through the file, which may be undesirable when `memory_map = true`.
+     * The checksum of the header is always verified.
+     * Ignored in `load_kmknn_prebuilt()`.
+     */
+    bool verify_checksums = true;
+};
+
 /**
  * @param dir Path to a directory in which a prebuilt KMKNN index was saved.
  * An Kmknn index would typically be saved by calling the `knncolle::Prebuilt::save()` method of the Kmknn subclass instance.
@@ -86,6 +108,101 @@ auto load_kmknn_prebuilt(const std::filesystem::path& dir) {
     >(dir);
 }
 
+/**
+ * Overload of `load_kmknn_prebuilt()` with additional options.
+ *
+ * @tparam Index_ Integer type for the observation indices.
+ * @tparam Data_ Numeric type for the input and query data.
+ * @tparam Distance_ Floating-point type for the distances.
+ * @tparam DistanceMetricData_ Class implementing the calculation of distances between observations.
+ * This should satisfy the `knncolle::DistanceMetric` interface.
+ * @tparam KmeansFloat_ Floating-point type of the cluster centroids.
+ * @tparam DistanceMetricCenter_ Class implementing the calculation of distances between an observation and a cluster centroid.
+ * This should satisfy the `knncolle::DistanceMetric` interface.
+ *
+ * @param dir Path to a directory in which a prebuilt KMKNN index was saved.
+ * @param options Further options for loading.
+ *
+ * @return Pointer to a `knncolle::Prebuilt` KMKNN index.
+ */
+template<
+    typename Index_,
+    typename Data_,
+    typename Distance_,
+    class DistanceMetricData_ = knncolle::DistanceMetric<Data_, Distance_>,
+    typename KmeansFloat_ = Distance_,
+    class DistanceMetricCenter_ = knncolle::DistanceMetric<KmeansFloat_, Distance_>
+>
+auto load_kmknn_prebuilt(const std::filesystem::path& dir, const KmknnLoadOptions& options) {
+    return new KmknnPrebuilt<
+        Index_,
+        Data_,
+        Distance_,
+        DistanceMetricData_,
+        KmeansFloat_,
+        DistanceMetricCenter_
+    >(dir, options.memory_map);
+}
+
+/**
+ * @param path Path to a file in which a prebuilt KMKNN index was saved by `save_kmknn_prebuilt_file()`.
+ *
+ * @return Template types of the saved instance of a `knncolle::Prebuilt` KMKNN subclass.
+ * This is typically used to choose template parameters for `load_kmknn_prebuilt_file()`.
+ */
+inline KmknnPrebuiltTypes load_kmknn_prebuilt_file_types(const std::filesystem::path& path) {
+    ContainerReader reader(path, false);
+    knncolle::NumericType type;
+    reader.load("FLOAT_TYPE", &type, 1);
+
+    KmknnPrebuiltTypes config;
+    config.kmeansfloat = type;
+
+    return config;
+}
+
+/**
+ * Load a prebuilt KMKNN index from a single file created by `save_kmknn_prebuilt_file()`.
+ * This is equivalent to `load_kmknn_prebuilt()` but only requires a single sequential read (or a single memory mapping, if `KmknnLoadOptions::memory_map = true`).
+ * An error is raised if the file is not a KMKNN index, has an unsupported format version, or fails its checksums.
+ *
+ * @tparam Index_ Integer type for the observation indices.
+ * @tparam Data_ Numeric type for the input and query data.
+ * @tparam Distance_ Floating-point type for the distances.
+ * @tparam DistanceMetricData_ Class implementing the calculation of distances between observations.
+ * This should satisfy the `knncolle::DistanceMetric` interface.
+ * @tparam KmeansFloat_ Floating-point type of the cluster centroids.
+ * @tparam DistanceMetricCenter_ Class implementing the calculation of distances between an observation and a cluster centroid.
+ * This should satisfy the `knncolle::DistanceMetric` interface.
+ *
+ * @param path Path to a file in which a prebuilt KMKNN index was saved.
+ * @param options Further options for loading.
+ *
+ * @return Pointer to a `knncolle::Prebuilt` KMKNN index.
+ */
+template<
+    typename Index_,
+    typename Data_,
+    typename Distance_,
+    class DistanceMetricData_ = knncolle::DistanceMetric<Data_, Distance_>,
+    typename KmeansFloat_ = Distance_,
+    class DistanceMetricCenter_ = knncolle::DistanceMetric<KmeansFloat_, Distance_>
+>
+auto load_kmknn_prebuilt_file(const std::filesystem::path& path, const KmknnLoadOptions& options = KmknnLoadOptions()) {
+    ContainerReader reader(path, options.verify_checksums);
+    if (reader.load_as_string("ALGORITHM") != kmknn_prebuilt_save_name) {
+        throw std::runtime_error("'" + path.string() + "' does not contain a KMKNN index");
+    }
+    return new KmknnPrebuilt<
+        Index_,
+        Data_,
+        Distance_,
+        DistanceMetricData_,
+        KmeansFloat_,
+        DistanceMetricCenter_
+    >(reader, options.memory_map);
+}
+
 }
 
 #endif
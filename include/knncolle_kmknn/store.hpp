@@ -0,0 +1,195 @@
+#ifndef KNNCOLLE_KMKNN_STORE_HPP
+#define KNNCOLLE_KMKNN_STORE_HPP
+
+#include "knncolle/knncolle.hpp"
+
+#include <vector>
+#include <memory>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <cstddef>
+#include <algorithm>
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @file store.hpp
+ * @brief Storage for the arrays of a KMKNN index.
+ */
+
+namespace knncolle_kmknn {
+
+/**
+ * @cond
+ */
+// Read-only memory mapping of an entire file.
+// On platforms without mmap(), we just read the file contents into memory.
+class MappedFile {
+public:
+    MappedFile(const std::filesystem::path& path) {
+#if !defined(_WIN32)
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("failed to open '" + path.string() + "' for memory mapping");
+        }
+
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            ::close(fd);
+            throw std::runtime_error("failed to determine the size of '" + path.string() + "'");
+        }
+        my_size = info.st_size;
+
+        if (my_size) {
+            void* ptr = ::mmap(NULL, my_size, PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd); // the mapping remains valid after closing the file descriptor.
+            if (ptr == MAP_FAILED) {
+                throw std::runtime_error("failed to memory map '" + path.string() + "'");
+            }
+            my_ptr = ptr;
+        } else {
+            ::close(fd);
+        }
+#else
+        my_size = std::filesystem::file_size(path);
+        my_fallback.resize(my_size);
+        knncolle::quick_load(path, my_fallback.data(), my_fallback.size());
+        my_ptr = my_fallback.data();
+#endif
+    }
+
+    ~MappedFile() {
+#if !defined(_WIN32)
+        if (my_ptr) {
+            ::munmap(my_ptr, my_size);
+        }
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+private:
+    void* my_ptr = NULL;
+    std::size_t my_size = 0;
+#if defined(_WIN32)
+    std::vector<unsigned char> my_fallback;
+#endif
+
+public:
+    const void* data() const {
+        return my_ptr;
+    }
+
+    std::size_t size() const {
+        return my_size;
+    }
+};
+
+// Array that is either owned by the index or references a read-only memory mapping.
+// Const access uses the mapping directly, while non-const access replaces the mapping with an owned copy.
+// This allows the index construction code to treat it like a std::vector.
+template<typename Type_>
+class ArrayStore {
+public:
+    ArrayStore() = default;
+
+    ArrayStore(std::vector<Type_> contents) : my_owned(std::move(contents)) {}
+
+private:
+    std::vector<Type_> my_owned;
+    std::shared_ptr<const MappedFile> my_mapping;
+    const Type_* my_mapped = NULL;
+    std::size_t my_mapped_size = 0;
+
+public:
+    bool is_mapped() const {
+        return my_mapping != nullptr;
+    }
+
+    void map(std::shared_ptr<const MappedFile> mapping, const Type_* ptr, std::size_t size) {
+        my_mapping = std::move(mapping);
+        my_mapped = ptr;
+        my_mapped_size = size;
+        my_owned.clear();
+        my_owned.shrink_to_fit();
+    }
+
+    // Memory-maps an entire file that was created by knncolle::quick_save() with 'size' elements of 'Type_'.
+    void map(const std::filesystem::path& path, std::size_t size) {
+        auto mapping = std::make_shared<const MappedFile>(path);
+        if (mapping->size() / sizeof(Type_) < size) {
+            throw std::runtime_error("file '" + path.string() + "' is too small for the requested number of elements");
+        }
+        auto ptr = static_cast<const Type_*>(mapping->data());
+        map(std::move(mapping), ptr, size);
+    }
+
+    std::vector<Type_>& get_mutable() {
+        if (my_mapping) {
+            my_owned.insert(my_owned.end(), my_mapped, my_mapped + my_mapped_size);
+            my_mapping.reset();
+            my_mapped = NULL;
+            my_mapped_size = 0;
+        }
+        return my_owned;
+    }
+
+public:
+    std::size_t size() const {
+        return (my_mapping ? my_mapped_size : my_owned.size());
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    const Type_* data() const {
+        return (my_mapping ? my_mapped : my_owned.data());
+    }
+
+    const Type_* begin() const {
+        return data();
+    }
+
+    const Type_* end() const {
+        return data() + size();
+    }
+
+    const Type_& operator[](std::size_t i) const {
+        return data()[i];
+    }
+
+    Type_* data() {
+        return get_mutable().data();
+    }
+
+    Type_& operator[](std::size_t i) {
+        return get_mutable()[i];
+    }
+
+    void resize(std::size_t size) {
+        get_mutable().resize(size);
+    }
+
+    void clear() {
+        get_mutable().clear();
+    }
+
+    void swap(std::vector<Type_>& other) {
+        get_mutable().swap(other);
+    }
+};
+/**
+ * @endcond
+ */
+
+}
+
+#endif
@@ -9,6 +9,9 @@
 #include <cstddef>
 #include <memory>
 #include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <numeric>
 
 class KmknnTest : public TestCore, public ::testing::TestWithParam<std::tuple<std::tuple<int, int>, int> > {
 protected:
@@ -106,6 +109,79 @@ TEST_P(KmknnTest, QueryEuclidean) {
     }
 }
 
+TEST_P(KmknnTest, BatchEuclidean) {
+    int k = std::get<1>(GetParam());    
+    auto eucdist = std::make_shared<knncolle::EuclideanDistance<double, double> >();
+
+    knncolle_kmknn::KmknnBuilder<int, double, double> kb(eucdist, eucdist);
+    auto kptr = kb.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+    auto ksptr = kptr->initialize_known();
+
+    // Using enough queries to span multiple blocks.
+    int nqueries = 150;
+    std::mt19937_64 rng(ndim * 20 + nobs - k);
+    std::vector<double> queries(nqueries * ndim);
+    fill_random(queries.begin(), queries.end(), rng);
+
+    std::vector<std::vector<int> > batch_i(nqueries);
+    std::vector<std::vector<double> > batch_d(nqueries);
+    ksptr->search_batch(queries.data(), nqueries, k, batch_i.data(), batch_d.data());
+
+    std::vector<int> ref_i;
+    std::vector<double> ref_d;
+    for (int q = 0; q < nqueries; ++q) {
+        ksptr->search(queries.data() + q * ndim, k, &ref_i, &ref_d);
+        EXPECT_EQ(batch_i[q], ref_i);
+        EXPECT_EQ(batch_d[q], ref_d);
+    }
+
+    // Trying with some NULLs.
+    std::vector<std::vector<double> > batch_d2(nqueries);
+    ksptr->search_batch(queries.data(), nqueries, k, NULL, batch_d2.data());
+    EXPECT_EQ(batch_d, batch_d2);
+    std::vector<std::vector<int> > batch_i2(nqueries);
+    ksptr->search_batch(queries.data(), nqueries, k, batch_i2.data(), NULL);
+    EXPECT_EQ(batch_i, batch_i2);
+
+    // Handles k = 0.
+    ksptr->search_batch(queries.data(), nqueries, 0, batch_i.data(), batch_d.data());
+    for (int q = 0; q < nqueries; ++q) {
+        EXPECT_TRUE(batch_i[q].empty());
+        EXPECT_TRUE(batch_d[q].empty());
+    }
+}
+
+TEST(Kmknn, BatchIndexLimit) {
+    // Using a small index type with enough queries that advancing past the last block would overflow.
+    int ndim = 3;
+    unsigned short nobs = 100, nqueries = 65500;
+    std::mt19937_64 rng(1357);
+    std::normal_distribution distr;
+    std::vector<double> data(ndim * nobs), queries(ndim * nqueries);
+    for (auto& d : data) {
+        d = distr(rng);
+    }
+    for (auto& q : queries) {
+        q = distr(rng);
+    }
+
+    auto eucdist = std::make_shared<knncolle::EuclideanDistance<double, double> >();
+    knncolle_kmknn::KmknnBuilder<unsigned short, double, double> kb(eucdist, eucdist);
+    auto kptr = kb.build_known_unique(knncolle::SimpleMatrix<unsigned short, double>(ndim, nobs, data.data()));
+    auto ksptr = kptr->initialize_known();
+
+    std::vector<std::vector<unsigned short> > batch_i(nqueries);
+    ksptr->search_batch(queries.data(), nqueries, 3, batch_i.data(), NULL);
+
+    std::vector<unsigned short> ref_i;
+    for (int q = 0; q < nqueries; q += 97) {
+        ksptr->search(queries.data() + q * ndim, 3, &ref_i, NULL);
+        EXPECT_EQ(batch_i[q], ref_i);
+    }
+    ksptr->search(queries.data() + (nqueries - 1) * ndim, 3, &ref_i, NULL);
+    EXPECT_EQ(batch_i.back(), ref_i);
+}
+
 TEST_P(KmknnTest, AllEuclidean) {
     int k = std::get<1>(GetParam());    
     auto eucdist = std::make_shared<knncolle::EuclideanDistance<double, double> >();
@@ -295,6 +371,885 @@ TEST_F(KmknnMiscTest, Options) {
     }
 }
 
+TEST_F(KmknnMiscTest, Parallel) {
+    auto eucdist = std::make_shared<knncolle::EuclideanDistance<double, double> >();
+    knncolle::SimpleMatrix<int, double> mat(ndim, nobs, data.data());
+    knncolle_kmknn::KmknnBuilder<int, double, double> kb(eucdist, eucdist);
+    auto kptr = kb.build_unique(mat);
+
+    kb.get_options().num_threads = 3;
+    auto kptr2 = kb.build_unique(mat);
+    kb.get_options().reorder_in_place = false;
+    auto kptr3 = kb.build_unique(mat);
+
+    std::vector<int> kres_i, kres2_i, kres3_i;
+    std::vector<double> kres_d, kres2_d, kres3_d;
+    auto ksptr = kptr->initialize();
+    auto ksptr2 = kptr2->initialize();
+    auto ksptr3 = kptr3->initialize();
+
+    for (int x = 0; x < nobs; ++x) {
+        ksptr->search(x, 5, &kres_i, &kres_d);
+        ksptr2->search(x, 5, &kres2_i, &kres2_d);
+        EXPECT_EQ(kres_i, kres2_i);
+        EXPECT_EQ(kres_d, kres2_d);
+        ksptr3->search(x, 5, &kres3_i, &kres3_d);
+        EXPECT_EQ(kres_i, kres3_i);
+        EXPECT_EQ(kres_d, kres3_d);
+    }
+}
+
+class CustomEuclideanDistance final : public knncolle::DistanceMetric<double, double> {
+public:
+    double raw(std::size_t num_dimensions, const double* x, const double* y) const {
+        return my_ref.raw(num_dimensions, x, y);
+    }
+    double normalize(double raw) const {
+        return my_ref.normalize(raw);
+    }
+    double denormalize(double norm) const {
+        return my_ref.denormalize(norm);
+    }
+private:
+    knncolle::EuclideanDistance<double, double> my_ref;
+};
+
+TEST_F(KmknnMiscTest, CustomDistance) {
+    // Checking that we get the same results when we can't use the specialized kernels.
+    auto eucdist = std::make_shared<knncolle::EuclideanDistance<double, double> >();
+    auto custdist = std::make_shared<CustomEuclideanDistance>();
+    knncolle::SimpleMatrix<int, double> mat(ndim, nobs, data.data());
+    knncolle_kmknn::KmknnBuilder<int, double, double> kb(eucdist, eucdist);
+    auto kptr = kb.build_unique(mat);
+    knncolle_kmknn::KmknnBuilder<int, double, double> kb2(custdist, custdist);
+    auto kptr2 = kb2.build_unique(mat);
+
+    std::vector<int> kres_i, kres2_i;
+    std::vector<double> kres_d, kres2_d;
+    auto ksptr = kptr->initialize();
+    auto ksptr2 = kptr2->initialize();
+
+    for (int x = 0; x < nobs; ++x) {
+        ksptr->search(x, 5, &kres_i, &kres_d);
+        ksptr2->search(x, 5, &kres2_i, &kres2_d);
+        EXPECT_EQ(kres_i, kres2_i);
+        EXPECT_EQ(kres_d, kres2_d);
+
+        double threshold = kres_d.back();
+        ksptr->search_all(x, threshold, &kres_i, &kres_d);
+        ksptr2->search_all(x, threshold, &kres2_i, &kres2_d);
+        EXPECT_EQ(kres_i, kres2_i);
+        EXPECT_EQ(kres_d, kres2_d);
+    }
+}
+
+class KmknnMetricTest : public TestCore, public ::testing::TestWithParam<TestMetric> {
+protected:
+    std::shared_ptr<const knncolle::DistanceMetric<double, double> > metric;
+
+    void SetUp() {
+        metric = create_metric(GetParam());
+    }
+};
+
+TEST_P(KmknnMetricTest, EarlyAbandon) {
+    assemble({ 300, 23 }); // using more dimensions so that there are multiple blocks.
+    BruteforceReference ref(ndim, nobs, data.data(), metric);
+
+    knncolle_kmknn::KmknnBuilder<int, double, double> kb(metric, metric);
+    kb.get_options().early_abandon_block = 4;
+    auto kptr = kb.build_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+    ref.compare_by_index(*(kptr->initialize()), 10);
+}
+
+TEST_P(KmknnMetricTest, Quantized) {
+    assemble({ 300, 12 });
+    BruteforceReference ref(ndim, nobs, data.data(), metric);
+
+    // Queries outside of the range of the data.
+    auto queries = simulate(nobs, ndim, 999);
+    for (int q = 0; q < nobs; ++q) {
+        queries[q * ndim + q % ndim] *= 5;
+    }
+
+    for (int early = 0; early < 2; ++early) {
+        knncolle_kmknn::KmknnBuilder<int, double, double> kb(metric, metric);
+        kb.get_options().quantize = true;
+        kb.get_options().early_abandon_block = early * 3;
+        auto kptr = kb.build_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+        auto ksptr = kptr->initialize();
+        ref.compare_by_index(*ksptr, 10);
+        ref.compare_by_query(*ksptr, queries, 10);
+    }
+}
+
+TEST_P(KmknnMetricTest, Add) {
+    assemble({ 300, 7 });
+
+    // Shifting the later observations so that they lie outside the range of the initial clusters.
+    auto shifted = data;
+    for (int i = ndim * 250; i < ndim * nobs; ++i) {
+        shifted[i] += 3;
+    }
+    BruteforceReference ref(ndim, nobs, shifted.data(), metric);
+
+    // Testing without any re-clustering, then with forced re-clustering, and starting from an empty index.
+    for (int config = 0; config < 3; ++config) {
+        knncolle_kmknn::KmknnBuilder<int, double, double> kb(metric, metric);
+        auto& opt = kb.get_options();
+        opt.quantize = true;
+        opt.num_threads = 2;
+        if (config == 1) {
+            opt.recluster_imbalance = 1;
+        }
+
+        const int initial = (config == 2 ? 0 : 200);
+        auto kptr = kb.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, initial, shifted.data()));
+        kptr->add(0, NULL, opt);
+        EXPECT_EQ(kptr->num_observations(), initial);
+
+        kptr->add(30, shifted.data() + ndim * initial, opt);
+        EXPECT_EQ(kptr->num_observations(), initial + 30);
+        kptr->add(nobs - initial - 30, shifted.data() + ndim * (initial + 30), opt);
+        EXPECT_EQ(kptr->num_observations(), nobs);
+
+        auto ksptr = kptr->initialize();
+        ref.compare_by_index(*ksptr, 10);
+        ref.compare_by_query(*ksptr, shifted, 10);
+    }
+
+    // Default options work as expected.
+    {
+        knncolle_kmknn::KmknnBuilder<int, double, double> kb(metric, metric);
+        auto kptr = kb.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, 100, shifted.data()));
+        kptr->add(nobs - 100, shifted.data() + ndim * 100);
+        ref.compare_by_index(*(kptr->initialize()), 5);
+    }
+
+    // Default options preserve the settings of an empty index when it is rebuilt upon addition.
+    {
+        knncolle_kmknn::KmknnBuilder<int, double, double> kb(metric, metric);
+        kb.get_options().quantize = true;
+        kb.get_options().tile_subjects = true;
+        kb.get_options().num_pivots = 2;
+        auto kptr = kb.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, 0, shifted.data()));
+        kptr->add(nobs, shifted.data());
+        ref.compare_by_index(*(kptr->initialize()), 5);
+
+        auto reloaded = save_and_load(*kptr, "kmknn-add-settings", [](const std::filesystem::path& dir) -> void {
+            EXPECT_TRUE(std::filesystem::exists(dir / "QUANTIZED"));
+            EXPECT_TRUE(std::filesystem::exists(dir / "TILED"));
+            EXPECT_TRUE(std::filesystem::exists(dir / "PIVOTS"));
+        });
+        ref.compare_by_index(*(reloaded->initialize()), 5);
+    }
+
+    // The settings also survive a round trip through save() before the addition.
+    // Reordering the dimensions changes the order of summation, so we only check that the reordering is still applied.
+    {
+        knncolle_kmknn::KmknnBuilder<int, double, double> kb(metric, metric);
+        kb.get_options().quantize = true;
+        kb.get_options().tile_subjects = true;
+        kb.get_options().reorder_dimensions = true;
+        auto kptr = kb.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, 0, shifted.data()));
+        const std::filesystem::path dir = "kmknn-add-settings";
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directory(dir);
+        kptr->save(dir);
+        std::unique_ptr<knncolle_kmknn::KmknnPrebuilt<int, double, double, knncolle::DistanceMetric<double, double>, double, knncolle::DistanceMetric<double, double> > > reloaded(
+            knncolle_kmknn::load_kmknn_prebuilt<int, double, double>(dir)
+        );
+        std::filesystem::remove_all(dir);
+
+        reloaded->add(nobs, shifted.data());
+        save_and_load(*reloaded, dir, [](const std::filesystem::path& dir) -> void {
+            EXPECT_TRUE(std::filesystem::exists(dir / "QUANTIZED"));
+            EXPECT_TRUE(std::filesystem::exists(dir / "TILED"));
+            EXPECT_TRUE(std::filesystem::exists(dir / "DIMENSION_ORDER"));
+        });
+    }
+}
+
+TEST_P(KmknnMetricTest, Remove) {
+    assemble({ 300, 6 });
+
+    // Deleting every third observation, along with an entire cluster's worth of duplicated points.
+    auto modified = data;
+    for (int i = 290; i < nobs; ++i) {
+        std::fill_n(modified.begin() + i * ndim, ndim, 100);
+    }
+    std::vector<int> keep;
+    for (int i = 0; i < 290; ++i) {
+        if (i % 3) {
+            keep.push_back(i);
+        }
+    }
+    const auto kept_data = subset_rows(modified, ndim, keep);
+    const int nkept = keep.size();
+    BruteforceReference ref(ndim, nkept, kept_data.data(), metric);
+
+    auto compare_search = [&](knncolle::Searcher<int, double, double>& searcher, bool original_ids) -> void {
+        ref.compare_by_index(searcher, 8, 1, original_ids ? &keep : NULL);
+        if (!original_ids) {
+            return;
+        }
+
+        // Deleted observations can still be used as queries.
+        std::vector<int> kres_i, ref_i;
+        std::vector<double> kres_d, ref_d;
+        for (int x = 0; x < 290; x += 3) {
+            searcher.search(x, 8, &kres_i, &kres_d);
+            ref.search(modified.data() + x * ndim, 8, ref_i, ref_d, &keep);
+            EXPECT_EQ(kres_i, ref_i);
+            EXPECT_EQ(kres_d, ref_d);
+
+            auto threshold = (ref_d[4] + ref_d[5]) / 2;
+            EXPECT_EQ(searcher.search_all(x, threshold, NULL, NULL), 5);
+            searcher.search_all(x, threshold, &kres_i, &kres_d);
+            ref_i.resize(5);
+            EXPECT_EQ(kres_i, ref_i);
+        }
+
+        searcher.search(295, 3, &kres_i, &kres_d);
+        EXPECT_EQ(searcher.search_all(295, 1, NULL, NULL), 0);
+    };
+
+    for (int quantize = 0; quantize < 2; ++quantize) {
+        knncolle_kmknn::KmknnBuilder<int, double, double> kb(metric, metric);
+        kb.get_options().quantize = quantize;
+        auto kptr = kb.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, modified.data()));
+        EXPECT_EQ(kptr->num_deleted(), 0);
+
+        for (int i = 0; i < nobs; ++i) {
+            if (i >= 290 || i % 3 == 0) {
+                kptr->remove(i);
+            }
+        }
+        kptr->remove(0); // no-op.
+        EXPECT_EQ(kptr->num_deleted(), nobs - nkept);
+        EXPECT_EQ(kptr->num_observations(), nobs);
+
+        compare_search(*(kptr->initialize()), true);
+
+        // Deletions survive saving and loading.
+        {
+            knncolle::register_load_euclidean_distance<double, double>();
+            knncolle::register_load_manhattan_distance<double, double>();
+            const std::filesystem::path path = "kmknn-remove-test.kmknn";
+            knncolle_kmknn::save_kmknn_prebuilt_file(*kptr, path);
+            std::unique_ptr<knncolle_kmknn::KmknnPrebuilt<int, double, double, knncolle::DistanceMetric<double, double>, double, knncolle::DistanceMetric<double, double> > > reloaded(
+                knncolle_kmknn::load_kmknn_prebuilt_file<int, double, double>(path)
+            );
+            EXPECT_EQ(reloaded->num_deleted(), nobs - nkept);
+            compare_search(*(reloaded->initialize()), true);
+            std::filesystem::remove(path);
+        }
+
+        // Deletions are preserved when new observations are added, with or without re-clustering.
+        for (int recluster = 0; recluster < 2; ++recluster) {
+            auto added = kb.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, 250, modified.data()));
+            for (int i = 0; i < 250; i += 3) {
+                added->remove(i);
+            }
+            auto opt = kb.get_options();
+            opt.recluster_imbalance = recluster;
+            added->add(nobs - 250, modified.data() + 250 * ndim, opt);
+            for (int i = 250; i < nobs; ++i) {
+                if (i >= 290 || i % 3 == 0) {
+                    added->remove(i);
+                }
+            }
+            compare_search(*(added->initialize()), true);
+        }
+
+        auto retained = kptr->compact();
+        EXPECT_EQ(retained, keep);
+        EXPECT_EQ(kptr->num_deleted(), 0);
+        EXPECT_EQ(kptr->num_observations(), nkept);
+        compare_search(*(kptr->initialize()), false);
+
+        // No-op when there's nothing to compact.
+        retained = kptr->compact();
+        EXPECT_EQ(retained.size(), nkept);
+        EXPECT_EQ(retained.front(), 0);
+        EXPECT_EQ(retained.back(), nkept - 1);
+    }
+
+    // Deleting everything.
+    {
+        knncolle_kmknn::KmknnBuilder<int, double, double> kb(metric, metric);
+        auto kptr = kb.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, 50, modified.data()));
+        for (int i = 0; i < 50; ++i) {
+            kptr->remove(i);
+        }
+
+        std::vector<int> kres_i;
+        auto ksptr = kptr->initialize();
+        ksptr->search(modified.data(), 5, &kres_i, NULL);
+        EXPECT_TRUE(kres_i.empty());
+
+        kptr->compact();
+        EXPECT_EQ(kptr->num_observations(), 0);
+        ksptr = kptr->initialize();
+        ksptr->search(modified.data(), 5, &kres_i, NULL);
+        EXPECT_TRUE(kres_i.empty());
+    }
+}
+
+TEST_P(KmknnMetricTest, Graph) {
+    assemble({ 500, 9 });
+    knncolle_kmknn::KmknnBuilder<int, double, double> kb(metric, metric);
+    kb.get_options().quantize = (GetParam() == TestMetric::MANHATTAN); // also covering the quantized filter.
+    auto kptr = kb.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+    auto ksptr = kptr->initialize();
+
+    // Each row of the graph should be the same as a search by index.
+    auto compare_graph = [&](const knncolle_kmknn::KmknnNeighborGraph<int, double>& graph, int k) -> void {
+        ASSERT_EQ(graph.pointers.size(), nobs + 1);
+        std::vector<int> ref_i;
+        std::vector<double> ref_d;
+        for (int x = 0; x < nobs; ++x) {
+            ksptr->search(x, k, &ref_i, &ref_d);
+            std::vector<int> obs_i(graph.indices.begin() + graph.pointers[x], graph.indices.begin() + graph.pointers[x + 1]);
+            std::vector<double> obs_d(graph.distances.begin() + graph.pointers[x], graph.distances.begin() + graph.pointers[x + 1]);
+            EXPECT_EQ(ref_i, obs_i);
+            EXPECT_EQ(ref_d, obs_d);
+        }
+    };
+
+    for (int k : { 1, 10 }) {
+        for (int nthreads : { 1, 3 }) {
+            auto graph = kptr->build_knn_graph(k, nthreads);
+            EXPECT_EQ(graph.indices.size(), nobs * k);
+            EXPECT_EQ(graph.distances.size(), nobs * k);
+            compare_graph(graph, k);
+        }
+    }
+
+    // Zero neighbors.
+    {
+        auto graph = kptr->build_knn_graph(0, 1);
+        EXPECT_EQ(graph.pointers, std::vector<std::size_t>(nobs + 1));
+        EXPECT_TRUE(graph.indices.empty());
+    }
+
+    // Works with clusters that span multiple blocks of queries.
+    {
+        kb.get_options().power = 0.2;
+        auto bigptr = kb.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+        auto bigsptr = bigptr->initialize();
+        auto graph = bigptr->build_knn_graph(5, 2);
+        std::vector<int> ref_i;
+        std::vector<double> ref_d;
+        for (int x = 0; x < nobs; ++x) {
+            bigsptr->search(x, 5, &ref_i, &ref_d);
+            EXPECT_EQ(ref_i, std::vector<int>(graph.indices.begin() + graph.pointers[x], graph.indices.begin() + graph.pointers[x + 1]));
+            EXPECT_EQ(ref_d, std::vector<double>(graph.distances.begin() + graph.pointers[x], graph.distances.begin() + graph.pointers[x + 1]));
+        }
+    }
+
+    // Works with deletions and more neighbors than observations.
+    for (int x = 0; x < nobs; x += 2) {
+        kptr->remove(x);
+    }
+    compare_graph(kptr->build_knn_graph(nobs, 2), nobs / 2);
+}
+
+TEST_P(KmknnMetricTest, SuperCenters) {
+    assemble({ 1000, 5 }, 7, 3);
+    BruteforceReference ref(ndim, nobs, data.data(), metric);
+
+    // Queries that are slightly perturbed from each observation.
+    std::vector<int> perturbed;
+    for (int x = 0; x < nobs; x += 3) {
+        perturbed.push_back(x);
+    }
+    auto queries = subset_rows(data, ndim, perturbed);
+    for (std::size_t q = 0; q < perturbed.size(); ++q) {
+        queries[q * ndim + perturbed[q] % ndim] += 0.5;
+    }
+
+    auto compare = [&](knncolle::Searcher<int, double, double>& searcher) -> void {
+        ref.compare_by_index(searcher, 10, 3);
+        ref.compare_by_query(searcher, queries, 10);
+    };
+
+    knncolle_kmknn::KmknnBuilder<int, double, double> kb(metric, metric);
+    kb.get_options().super_center_power = 0.5;
+    {
+        auto kptr = kb.build_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+        compare(*(kptr->initialize()));
+        auto reloaded = save_and_load(*kptr, "kmknn-super-test");
+        compare(*(reloaded->initialize()));
+    }
+
+    // Still works after adding new observations.
+    {
+        auto kptr = kb.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, 500, data.data()));
+        kptr->add(nobs - 500, data.data() + 500 * ndim, kb.get_options());
+        compare(*(kptr->initialize()));
+    }
+
+    // Still works after compaction that empties some clusters.
+    {
+        auto kptr = kb.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+        std::vector<int> keep;
+        for (int x = 0; x < nobs; ++x) {
+            if (x % 7 < 3) {
+                kptr->remove(x);
+            } else {
+                keep.push_back(x);
+            }
+        }
+        kptr->compact();
+
+        const auto kept_data = subset_rows(data, ndim, keep);
+        BruteforceReference kept_ref(ndim, keep.size(), kept_data.data(), metric);
+        kept_ref.compare_by_index(*(kptr->initialize()), 5, 2);
+    }
+}
+
+TEST_P(KmknnMetricTest, Pivots) {
+    // Using a few large, well-separated clusters so that many subjects can be skipped by the pivots.
+    assemble({ 1000, 20 }, 4, 5);
+    const auto queries = simulate(20, ndim, 13579, 4, 5);
+    BruteforceReference ref(ndim, nobs, data.data(), metric);
+
+    knncolle_kmknn::KmknnBuilder<int, double, double> kb(metric, metric);
+    kb.get_options().power = 0.3;
+    kb.get_options().num_pivots = 3;
+    auto kptr = kb.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+    {
+        auto ksptr = kptr->initialize_known();
+        ref.compare_by_index(*ksptr, 8);
+        ref.compare_by_query(*ksptr, queries, 8);
+    }
+
+    // Pivots are preserved upon saving and loading.
+    auto reloaded = save_and_load(*kptr, "kmknn-pivots", [](const std::filesystem::path& dir) -> void {
+        EXPECT_TRUE(std::filesystem::exists(dir / "PIVOTS"));
+        EXPECT_TRUE(std::filesystem::exists(dir / "PIVOT_DISTANCES"));
+    });
+    ref.compare_by_query(*(reloaded->initialize()), queries, 8);
+
+    // Pivot distances are recomputed after adding new observations.
+    const int nfirst = 600;
+    auto partial = kb.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nfirst, data.data()));
+    partial->add(nobs - nfirst, data.data() + nfirst * ndim);
+    ref.compare_by_index(*(partial->initialize_known()), 8, 3);
+
+    // Same after removing and compacting.
+    std::vector<int> keep;
+    for (int x = 0; x < nobs; ++x) {
+        if (x % 5 == 0) {
+            partial->remove(x);
+        } else {
+            keep.push_back(x);
+        }
+    }
+    EXPECT_EQ(partial->compact(), keep);
+    const auto kept_data = subset_rows(data, ndim, keep);
+    BruteforceReference kept_ref(ndim, keep.size(), kept_data.data(), metric);
+    kept_ref.compare_by_query(*(partial->initialize_known()), queries, 8);
+}
+
+TEST_P(KmknnMetricTest, TiledSubjects) {
+    assemble({ 503, 7 }); // using an odd number of dimensions so that the tiles need to be padded.
+    const auto queries = simulate(20, ndim, 8642);
+    BruteforceReference ref(ndim, nobs, data.data(), metric);
+    knncolle::SimpleMatrix<int, double> mat(ndim, nobs, data.data());
+
+    knncolle_kmknn::KmknnBuilder<int, double, double> kb(metric, metric);
+    kb.get_options().tile_subjects = true;
+    auto kptr = kb.build_known_unique(mat);
+    {
+        auto ksptr = kptr->initialize();
+        ref.compare_by_index(*ksptr, 5);
+        ref.compare_by_query(*ksptr, queries, 10);
+    }
+
+    // Tiles are recomputed upon loading.
+    auto reloaded = save_and_load(*kptr, "kmknn-tiled-subjects", [](const std::filesystem::path& dir) -> void {
+        EXPECT_TRUE(std::filesystem::exists(dir / "TILED"));
+    });
+    ref.compare_by_query(*(reloaded->initialize()), queries, 10);
+
+    // Tiles are recomputed after adding new observations.
+    const int nfirst = 301;
+    auto partial = kb.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nfirst, data.data()));
+    partial->add(nobs - nfirst, data.data() + nfirst * ndim);
+    ref.compare_by_query(*(partial->initialize()), queries, 10);
+
+    // Deleted observations are ignored in each tile, and the tiles are recomputed after compaction.
+    std::vector<int> keep;
+    for (int x = 0; x < nobs; ++x) {
+        if (x % 3 == 0) {
+            partial->remove(x);
+        } else {
+            keep.push_back(x);
+        }
+    }
+    const auto kept_data = subset_rows(data, ndim, keep);
+    BruteforceReference kept_ref(ndim, keep.size(), kept_data.data(), metric);
+    kept_ref.compare_by_query(*(partial->initialize()), queries, 10, &keep);
+
+    EXPECT_EQ(partial->compact(), keep);
+    kept_ref.compare_by_query(*(partial->initialize()), queries, 10);
+
+    // Tiles are not supported for streaming builds.
+    {
+        const std::filesystem::path dir = "kmknn-tiled-streaming";
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directory(dir);
+        knncolle_kmknn::KmknnStreamingOptions sopt;
+        EXPECT_ANY_THROW(kb.build_streaming_unique(mat, dir, sopt));
+        std::filesystem::remove_all(dir);
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Kmknn,
+    KmknnMetricTest,
+    ::testing::Values(TestMetric::EUCLIDEAN, TestMetric::MANHATTAN)
+);
+
+class KmknnEuclideanTest : public TestCore, public ::testing::Test {
+protected:
+    std::shared_ptr<const knncolle::DistanceMetric<double, double> > metric = create_metric(TestMetric::EUCLIDEAN);
+};
+
+TEST_F(KmknnEuclideanTest, SeparatedClusters) {
+    // Well-separated clusters, so most centers should be pruned by the early termination in the center loop.
+    assemble({ 400, 4 }, 20, 50);
+    BruteforceReference ref(ndim, nobs, data.data(), metric);
+
+    knncolle_kmknn::KmknnBuilder<int, double, double> kb(metric, metric);
+    auto kptr = kb.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+    auto ksptr = kptr->initialize_known();
+    ref.compare_by_index(*ksptr, 5);
+    ref.compare_batch(*ksptr, data, 5);
+}
+
+TEST_F(KmknnEuclideanTest, Annulus) {
+    // Observations lie on spherical shells, so queries near the middle of each shell fall inside the annulus of its cluster.
+    assemble({ 600, 3 });
+    auto shells = data;
+    std::mt19937_64 rng(2718);
+    std::uniform_real_distribution unif(0.0, 2.0);
+    for (int i = 0; i < nobs; ++i) {
+        auto ptr = shells.data() + i * ndim;
+        double l2 = 0;
+        for (int d = 0; d < ndim; ++d) {
+            l2 += ptr[d] * ptr[d];
+        }
+        const double radius = 10 + unif(rng);
+        l2 = std::sqrt(l2);
+        for (int d = 0; d < ndim; ++d) {
+            ptr[d] = ptr[d] / l2 * radius + (i % 3) * 100;
+        }
+    }
+    BruteforceReference ref(ndim, nobs, shells.data(), metric);
+
+    knncolle_kmknn::KmknnBuilder<int, double, double> kb(metric, metric);
+    kb.get_options().power = 0.2;
+    auto kptr = kb.build_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, shells.data()));
+    auto ksptr = kptr->initialize();
+
+    std::vector<int> kres_i, ref_i;
+    std::vector<double> kres_d, ref_d;
+    std::vector<double> centers;
+    for (int c = 0; c < 3; ++c) {
+        std::vector<double> query(ndim, c * 100);
+        EXPECT_EQ(ksptr->search_all(query.data(), 5, NULL, NULL), 0);
+
+        for (double threshold : { 9.0, 11.0, 12.5 }) {
+            ksptr->search_all(query.data(), threshold, &kres_i, &kres_d);
+            ref.search(query.data(), nobs, ref_i, ref_d);
+            const auto num = std::upper_bound(ref_d.begin(), ref_d.end(), threshold) - ref_d.begin();
+            ref_i.resize(num);
+            ref_d.resize(num);
+            EXPECT_EQ(kres_i, ref_i);
+            EXPECT_EQ(kres_d, ref_d);
+        }
+        centers.insert(centers.end(), query.begin(), query.end());
+    }
+
+    ref.compare_by_query(*ksptr, centers, 5);
+    ref.compare_by_index(*ksptr, 8, 5);
+}
+
+TEST_F(KmknnEuclideanTest, Approximate) {
+    assemble({ 1000, 6 });
+    BruteforceReference ref(ndim, nobs, data.data(), metric);
+    knncolle::SimpleMatrix<int, double> mat(ndim, nobs, data.data());
+
+    for (double super_power : { 0.0, 0.5 }) {
+        knncolle_kmknn::KmknnBuilder<int, double, double> kb(metric, metric);
+        kb.get_options().super_center_power = super_power;
+        auto kptr = kb.build_known_unique(mat);
+
+        // No approximation, or limits that are never reached.
+        {
+            knncolle_kmknn::KmknnSearchOptions opt;
+            opt.max_centers_visited = 100000;
+            ref.compare_by_index(*(kptr->initialize_known()), 10, 7);
+            ref.compare_by_index(*(kptr->initialize(opt)), 10, 7);
+        }
+
+        // Each reported distance should be within (1 + epsilon) of the true distance.
+        for (double eps : { 0.1, 1.0 }) {
+            knncolle_kmknn::KmknnSearchOptions opt;
+            opt.epsilon = eps;
+            auto approx = kptr->initialize_known(opt);
+            std::vector<int> kres_i, ref_i;
+            std::vector<double> kres_d, ref_d;
+            for (int x = 0; x < nobs; x += 7) {
+                ref.search(x, 10, ref_i, ref_d);
+                approx->search(x, 10, &kres_i, &kres_d);
+                ASSERT_EQ(kres_d.size(), ref_d.size());
+                EXPECT_TRUE(std::is_sorted(kres_d.begin(), kres_d.end()));
+                for (int j = 0; j < 10; ++j) {
+                    EXPECT_GE(kres_d[j], ref_d[j]);
+                    EXPECT_LE(kres_d[j], ref_d[j] * (1 + eps) * (1 + 1e-8));
+                }
+            }
+
+            // Same guarantees for the batch search.
+            std::vector<std::vector<int> > batch_i(nobs);
+            std::vector<std::vector<double> > batch_d(nobs);
+            approx->search_batch(data.data(), nobs, 10, batch_i.data(), batch_d.data());
+            for (int x = 0; x < nobs; x += 7) {
+                ref.search(data.data() + x * ndim, 10, ref_i, ref_d);
+                ASSERT_EQ(batch_d[x].size(), ref_d.size());
+                for (int j = 0; j < 10; ++j) {
+                    EXPECT_GE(batch_d[x][j], ref_d[j]);
+                    EXPECT_LE(batch_d[x][j], ref_d[j] * (1 + eps) * (1 + 1e-8));
+                }
+            }
+
+            // search_all() is still exact.
+            for (int x = 0; x < nobs; x += 7) {
+                ref.search(x, 10, ref_i, ref_d);
+                approx->search_all(x, (ref_d[4] + ref_d[5]) / 2, &kres_i, &kres_d);
+                ref_i.resize(5);
+                EXPECT_EQ(kres_i, ref_i);
+            }
+        }
+
+        // Only searching the nearest center, which should still find k valid neighbors.
+        {
+            knncolle_kmknn::KmknnSearchOptions opt;
+            opt.max_centers_visited = 1;
+            auto approx = kptr->initialize_known(opt);
+            std::vector<int> kres_i, ref_i;
+            std::vector<double> kres_d, ref_d;
+            int found = 0;
+            for (int x = 0; x < nobs; x += 7) {
+                ref.search(x, 5, ref_i, ref_d);
+                approx->search(x, 5, &kres_i, &kres_d);
+                EXPECT_TRUE(std::is_sorted(kres_d.begin(), kres_d.end()));
+                EXPECT_LE(kres_d.size(), 5);
+                for (std::size_t j = 0; j < kres_d.size(); ++j) {
+                    EXPECT_GE(kres_d[j], ref_d[j]);
+                    found += (std::find(ref_i.begin(), ref_i.end(), kres_i[j]) != ref_i.end());
+                }
+            }
+            EXPECT_GT(found, 0);
+        }
+    }
+
+    knncolle_kmknn::KmknnBuilder<int, double, double> kb(metric, metric);
+    auto kptr = kb.build_known_unique(mat);
+    knncolle_kmknn::KmknnSearchOptions opt;
+    opt.epsilon = -1;
+    EXPECT_ANY_THROW(kptr->initialize_known(opt));
+}
+
+TEST_F(KmknnEuclideanTest, TunedPower) {
+    assemble({ 2000, 4 }, 10, 5);
+    BruteforceReference ref(ndim, nobs, data.data(), metric);
+    knncolle::SimpleMatrix<int, double> mat(ndim, nobs, data.data());
+
+    knncolle_kmknn::KmknnBuilder<int, double, double> kb(metric, metric);
+    kb.get_options().candidate_powers = { 0.2, 0.4, 0.6, 0.8 };
+    kb.get_options().tuning_subsample_size = 500;
+    kb.get_options().tuning_num_queries = 50;
+    auto kptr = kb.build_known_unique(mat);
+    const auto chosen = kptr->get_power();
+    EXPECT_TRUE(chosen == 0.2 || chosen == 0.4 || chosen == 0.6 || chosen == 0.8);
+
+    // Tuning is deterministic.
+    auto kptr2 = kb.build_known_unique(mat);
+    EXPECT_EQ(kptr2->get_power(), chosen);
+
+    // Results are still exact.
+    ref.compare_by_index(*(kptr->initialize()), 10, 11);
+
+    // The chosen power is the same as directly specifying it.
+    {
+        knncolle_kmknn::KmknnBuilder<int, double, double> kb2(metric, metric);
+        kb2.get_options().power = chosen;
+        auto direct = kb2.build_known_unique(mat);
+        EXPECT_EQ(direct->get_power(), chosen);
+        EXPECT_EQ(knncolle::find_nearest_neighbors(*direct, 5), knncolle::find_nearest_neighbors(*kptr, 5));
+    }
+
+    // A single candidate is used directly.
+    {
+        knncolle_kmknn::KmknnBuilder<int, double, double> kb2(metric, metric);
+        kb2.get_options().candidate_powers = { 0.3 };
+        EXPECT_EQ(kb2.build_known_unique(mat)->get_power(), 0.3);
+    }
+
+    // Chosen power is preserved after saving and loading.
+    {
+        knncolle::register_load_euclidean_distance<double, double>();
+        const std::filesystem::path path = "kmknn-tuned-test.kmknn";
+        knncolle_kmknn::save_kmknn_prebuilt_file(*kptr, path);
+        std::unique_ptr<knncolle_kmknn::KmknnPrebuilt<int, double, double, knncolle::DistanceMetric<double, double>, double, knncolle::DistanceMetric<double, double> > > reloaded(
+            knncolle_kmknn::load_kmknn_prebuilt_file<int, double, double>(path)
+        );
+        EXPECT_EQ(reloaded->get_power(), chosen);
+        std::filesystem::remove(path);
+    }
+}
+
+TEST_F(KmknnEuclideanTest, SubsampledKmeans) {
+    assemble({ 3000, 5 }, 8, 4);
+    BruteforceReference ref(ndim, nobs, data.data(), metric);
+    knncolle::SimpleMatrix<int, double> mat(ndim, nobs, data.data());
+
+    for (int sub : { 10, 300, 5000 }) { // smaller than the number of centers, typical, and larger than the number of observations.
+        knncolle_kmknn::KmknnBuilder<int, double, double> kb(metric, metric);
+        kb.get_options().kmeans_subsample_size = sub;
+        kb.get_options().num_threads = 3;
+        auto kptr = kb.build_unique(mat);
+        ref.compare_by_index(*(kptr->initialize()), 8, 13);
+    }
+
+    // Same result regardless of the number of threads.
+    {
+        knncolle_kmknn::KmknnBuilder<int, double, double> kb(metric, metric);
+        kb.get_options().kmeans_subsample_size = 500;
+        auto serial = kb.build_unique(mat);
+        kb.get_options().num_threads = 4;
+        auto parallel = kb.build_unique(mat);
+
+        const std::filesystem::path dir1 = "kmknn-subsample-serial", dir2 = "kmknn-subsample-parallel";
+        for (const auto& dir : { dir1, dir2 }) {
+            std::filesystem::remove_all(dir);
+            std::filesystem::create_directory(dir);
+        }
+        serial->save(dir1);
+        parallel->save(dir2);
+        for (const auto& name : { "CENTERS", "OBSERVATION_ID", "SIZES" }) {
+            EXPECT_EQ(knncolle::quick_load_as_string(dir1 / name), knncolle::quick_load_as_string(dir2 / name));
+        }
+        std::filesystem::remove_all(dir1);
+        std::filesystem::remove_all(dir2);
+    }
+}
+
+TEST_F(KmknnEuclideanTest, MaxClusterSize) {
+    // Skewed data with one dense blob, a sparse background, and a block of exact duplicates that cannot be split by k-means.
+    assemble({ 2000, 3 });
+    auto skewed = data;
+    for (int i = 0; i < nobs; ++i) {
+        for (int d = 0; d < ndim; ++d) {
+            auto& current = skewed[i * ndim + d];
+            if (i < 1200) {
+                current *= 0.1;
+            } else if (i < 1800) {
+                current *= 10;
+            } else {
+                current = 20;
+            }
+        }
+    }
+    BruteforceReference ref(ndim, nobs, skewed.data(), metric);
+
+    for (int cap : { 50, 7 }) {
+        knncolle_kmknn::KmknnBuilder<int, double, double> kb(metric, metric);
+        kb.get_options().power = 0.2;
+        kb.get_options().max_cluster_size = cap;
+        auto kptr = kb.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, skewed.data()));
+
+        // Checking the cluster sizes via the saved index.
+        const std::filesystem::path dir = "kmknn-max-cluster-size";
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directory(dir);
+        kptr->save(dir);
+        std::size_t ncenters = 0;
+        knncolle::quick_load(dir / "NUM_CENTERS", &ncenters, 1);
+        std::vector<int> sizes(ncenters);
+        knncolle::quick_load(dir / "SIZES", sizes.data(), sizes.size());
+        std::filesystem::remove_all(dir);
+        EXPECT_GE(ncenters, static_cast<std::size_t>(nobs / cap));
+        EXPECT_LE(*std::max_element(sizes.begin(), sizes.end()), cap);
+        EXPECT_EQ(std::accumulate(sizes.begin(), sizes.end(), 0), nobs);
+
+        auto ksptr = kptr->initialize();
+        std::vector<int> kres_i, ref_i;
+        std::vector<double> kres_d, ref_d;
+        for (int x = 0; x < 1800; x += 9) {
+            ksptr->search(x, 6, &kres_i, &kres_d);
+            ref.search(x, 6, ref_i, ref_d);
+            EXPECT_EQ(kres_i, ref_i);
+            EXPECT_EQ(kres_d, ref_d);
+        }
+
+        // Duplicates are tied so we only compare the distances.
+        for (int x = 1800; x < nobs; x += 9) {
+            ksptr->search(x, 6, &kres_i, &kres_d);
+            ref.search(x, 6, ref_i, ref_d);
+            EXPECT_EQ(kres_d, ref_d);
+        }
+    }
+}
+
+TEST_F(KmknnEuclideanTest, ReorderDimensions) {
+    // Anisotropic data where the variance increases with the dimension index, so the reordering is non-trivial.
+    // Integer coordinates ensure that the distances are exact regardless of the order of summation.
+    assemble({ 500, 8 });
+    auto anisotropic = [&](std::vector<double> values) -> std::vector<double> {
+        for (std::size_t i = 0; i < values.size(); ++i) {
+            const int d = i % ndim;
+            values[i] = std::round(values[i] * 100 * (d + 1) * (d + 1));
+        }
+        return values;
+    };
+    const auto scaled = anisotropic(data);
+    const auto queries = anisotropic(simulate(20, ndim, 2468));
+    BruteforceReference ref(ndim, nobs, scaled.data(), metric);
+
+    knncolle_kmknn::KmknnBuilder<int, double, double> kb(metric, metric);
+    kb.get_options().reorder_dimensions = true;
+    kb.get_options().early_abandon_block = 2;
+    auto kptr = kb.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, scaled.data()));
+    {
+        auto ksptr = kptr->initialize_known();
+        ref.compare_by_index(*ksptr, 6);
+        ref.compare_by_query(*ksptr, queries, 6);
+        ref.compare_batch(*ksptr, queries, 6);
+    }
+
+    // The permutation is preserved upon saving and loading.
+    auto reloaded = save_and_load(*kptr, "kmknn-reorder-dimensions", [&](const std::filesystem::path& dir) -> void {
+        EXPECT_TRUE(std::filesystem::exists(dir / "DIMENSION_ORDER"));
+        std::vector<std::size_t> order(ndim);
+        knncolle::quick_load(dir / "DIMENSION_ORDER", order.data(), order.size());
+        EXPECT_EQ(order.front(), ndim - 1);
+        EXPECT_EQ(order.back(), 0);
+    });
+    ref.compare_by_query(*(reloaded->initialize()), queries, 6);
+
+    // New observations are permuted before they are added.
+    const int nfirst = 400;
+    auto partial = kb.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nfirst, scaled.data()));
+    partial->add(nobs - nfirst, scaled.data() + nfirst * ndim);
+    ref.compare_by_index(*(partial->initialize_known()), 6, 7);
+}
+
 TEST_F(KmknnMiscTest, OtherTypes) {
     // Creating integers from [-10, 10].
     auto copy = data;
@@ -335,6 +1290,106 @@ TEST_F(KmknnMiscTest, OtherTypes) {
         EXPECT_EQ(kres_i, kres2_i);
         EXPECT_EQ(kres_d, kres2_d);
     }
+
+    // Checking that the batch search handles the conversion correctly.
+    auto kptr3 = altkb.build_known_unique(knncolle::SimpleMatrix<int, std::int64_t>(ndim, nobs, idata.data()));
+    auto ksptr3 = kptr3->initialize_known();
+    std::vector<std::vector<int> > batch_i(nobs);
+    std::vector<std::vector<double> > batch_d(nobs);
+    ksptr3->search_batch(idata.data(), nobs, 5, batch_i.data(), batch_d.data());
+    for (int x = 0; x < nobs; ++x) {
+        ksptr3->search(idata.data() + x * ndim, 5, &kres2_i, &kres2_d);
+        EXPECT_EQ(batch_i[x], kres2_i);
+        EXPECT_EQ(batch_d[x], kres2_d);
+    }
+}
+
+TEST_F(KmknnMiscTest, ConvertedKmeansData) {
+    auto copy = data;
+    for (auto& d : copy) {
+        d = std::max(-10.0, std::min(10.0, std::round(d * 10.0)));
+    }
+    std::vector<std::int64_t> idata(copy.begin(), copy.end());
+
+    auto refeucdist = std::make_shared<knncolle::EuclideanDistance<double, double> >();
+    knncolle_kmknn::KmknnBuilder<int, double, double> refkb(refeucdist, refeucdist);
+    auto refptr = refkb.build_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, copy.data()));
+    auto refsptr = refptr->initialize();
+
+    auto inteucdist = std::make_shared<knncolle::EuclideanDistance<std::int64_t, double> >();
+    std::vector<int> ref_i, kres_i;
+    std::vector<double> ref_d, kres_d;
+    auto compare = [&](const auto& kptr) -> void {
+        auto ksptr = kptr->initialize();
+        for (int x = 0; x < nobs; ++x) {
+            refsptr->search(x, 5, &ref_i, &ref_d);
+            ksptr->search(x, 5, &kres_i, &kres_d);
+            EXPECT_EQ(ref_i, kres_i);
+            EXPECT_EQ(ref_d, kres_d);
+        }
+    };
+
+    // User-supplied algorithms for the generic kmeans::Matrix interface are directly applied to the converting matrix.
+    {
+        typedef kmeans::Matrix<int, double> Generic;
+        knncolle_kmknn::KmknnBuilder<
+            int,
+            std::int64_t,
+            double,
+            knncolle::Matrix<int, std::int64_t>,
+            knncolle::DistanceMetric<std::int64_t, double>,
+            int,
+            double,
+            int,
+            double,
+            Generic
+        > kb(inteucdist, refeucdist);
+        kb.get_options().initialize_algorithm.reset(new kmeans::InitializeKmeanspp<int, double, int, double, Generic>);
+        kb.get_options().refine_algorithm.reset(new kmeans::RefineHartiganWong<int, double, int, double, Generic>);
+        compare(kb.build_unique(knncolle::SimpleMatrix<int, std::int64_t>(ndim, nobs, idata.data())));
+    }
+
+    // Otherwise, user-supplied algorithms are applied to a converted copy.
+    {
+        knncolle_kmknn::KmknnBuilder<int, std::int64_t, double, knncolle::Matrix<int, std::int64_t>, knncolle::DistanceMetric<std::int64_t, double>, int, double> kb(inteucdist, refeucdist);
+        kb.get_options().refine_algorithm.reset(new kmeans::RefineHartiganWong<int, double, int, double, kmeans::SimpleMatrix<int, double> >);
+        compare(kb.build_unique(knncolle::SimpleMatrix<int, std::int64_t>(ndim, nobs, idata.data())));
+    }
+
+    // Checking the extractors of the converting matrix, using enough dimensions to span multiple blocks.
+    {
+        const int bigdim = 1000;
+        std::vector<std::int64_t> bigdata(bigdim * nobs);
+        std::iota(bigdata.begin(), bigdata.end(), static_cast<std::int64_t>(0));
+        knncolle_kmknn::ConvertedMatrix<int, std::int64_t, double> converted(bigdim, nobs, bigdata.data());
+        EXPECT_EQ(converted.num_observations(), nobs);
+        EXPECT_EQ(converted.num_dimensions(), bigdim);
+
+        auto expect_row = [&](const double* ptr, int i) -> void {
+            std::vector<double> expected(bigdata.begin() + i * bigdim, bigdata.begin() + (i + 1) * bigdim);
+            EXPECT_EQ(std::vector<double>(ptr, ptr + bigdim), expected);
+        };
+
+        auto rext = converted.new_extractor();
+        for (int i = nobs - 1; i >= 0; i -= 3) {
+            expect_row(rext->get_observation(i), i);
+        }
+
+        const int start = 3;
+        auto cext = converted.new_extractor(start, nobs - start);
+        for (int i = start; i < nobs; ++i) {
+            expect_row(cext->get_observation(), i);
+        }
+
+        std::vector<int> sequence;
+        for (int i = 1; i < nobs; i += 2) {
+            sequence.push_back(i);
+        }
+        auto iext = converted.new_extractor(sequence.data(), sequence.size());
+        for (auto i : sequence) {
+            expect_row(iext->get_observation(), i);
+        }
+    }
 }
 
 TEST(Kmknn, AllZero) {
@@ -1,9 +1,19 @@
 #ifndef TESTCORE_H
 #define TESTCORE_H
 
+#include <gtest/gtest.h>
+
+#include "knncolle_kmknn/knncolle_kmknn.hpp"
+
 #include <vector>
 #include <tuple>
 #include <random>
+#include <memory>
+#include <filesystem>
+#include <cstdint>
+#include <algorithm>
+
+enum class TestMetric : char { EUCLIDEAN, MANHATTAN };
 
 class TestCore {
 protected:
@@ -30,6 +40,15 @@ protected:
         }
     }
 
+    // Same as above, but for a mixture of 'nclusters' standard normal distributions.
+    // The data is always regenerated as the cache only considers the number of observations and dimensions.
+    static void assemble(const std::tuple<int, int>& param, int nclusters, double spacing) {
+        last_params = std::tuple<int, int>(-1, -1);
+        nobs = std::get<0>(param);
+        ndim = std::get<1>(param);
+        data = simulate(nobs, ndim, nobs * 10 + ndim, nclusters, spacing);
+    }
+
     template<class It_, class Rng_>
     static void fill_random(It_ start, It_ end, Rng_& eng) {
         std::normal_distribution distr;
@@ -38,6 +57,166 @@ protected:
             ++start;
         }
     }
+
+    // Simulates 'n' observations from a mixture of 'nclusters' standard normal distributions,
+    // where the 'i'-th observation is shifted by '(i % nclusters) * spacing' in each dimension.
+    static std::vector<double> simulate(int n, int nd, std::uint64_t seed, int nclusters = 1, double spacing = 0) {
+        std::mt19937_64 rng(seed);
+        std::vector<double> output(n * nd);
+        fill_random(output.begin(), output.end(), rng);
+        for (int i = 0; i < n; ++i) {
+            const double shift = (i % nclusters) * spacing;
+            for (int d = 0; d < nd; ++d) {
+                output[i * nd + d] += shift;
+            }
+        }
+        return output;
+    }
+
+    // Rows of a row-major 'nd'-dimensional array, in the order of 'rows'.
+    static std::vector<double> subset_rows(const std::vector<double>& input, int nd, const std::vector<int>& rows) {
+        std::vector<double> output;
+        output.reserve(rows.size() * nd);
+        for (auto r : rows) {
+            output.insert(output.end(), input.begin() + r * nd, input.begin() + (r + 1) * nd);
+        }
+        return output;
+    }
+
+    static std::shared_ptr<const knncolle::DistanceMetric<double, double> > create_metric(TestMetric metric) {
+        if (metric == TestMetric::EUCLIDEAN) {
+            return std::make_shared<knncolle::EuclideanDistance<double, double> >();
+        } else {
+            return std::make_shared<knncolle::ManhattanDistance<double, double> >();
+        }
+    }
+
+    // Saves 'prebuilt' to a fresh directory, calls 'inspect(dir)' to check the saved files, and then loads it back.
+    template<class Inspect_>
+    static std::unique_ptr<knncolle::Prebuilt<int, double, double> > save_and_load(const knncolle::Prebuilt<int, double, double>& prebuilt, const std::filesystem::path& dir, Inspect_ inspect) {
+        knncolle::register_load_euclidean_distance<double, double>();
+        knncolle::register_load_manhattan_distance<double, double>();
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directory(dir);
+        prebuilt.save(dir);
+        inspect(dir);
+        std::unique_ptr<knncolle::Prebuilt<int, double, double> > output(knncolle_kmknn::load_kmknn_prebuilt<int, double, double>(dir));
+        std::filesystem::remove_all(dir);
+        return output;
+    }
+
+    static std::unique_ptr<knncolle::Prebuilt<int, double, double> > save_and_load(const knncolle::Prebuilt<int, double, double>& prebuilt, const std::filesystem::path& dir) {
+        return save_and_load(prebuilt, dir, [](const std::filesystem::path&) -> void {});
+    }
+};
+
+// Exact results from a brute-force search, for comparison to the KMKNN searchers.
+class BruteforceReference {
+public:
+    BruteforceReference(int nd, int n, const double* ptr, std::shared_ptr<const knncolle::DistanceMetric<double, double> > metric) :
+        my_dim(nd),
+        my_obs(n),
+        my_prebuilt(knncolle::BruteforceBuilder<int, double, double>(std::move(metric)).build_unique(knncolle::SimpleMatrix<int, double>(nd, n, ptr))),
+        my_searcher(my_prebuilt->initialize())
+    {}
+
+private:
+    int my_dim, my_obs;
+    std::unique_ptr<knncolle::Prebuilt<int, double, double> > my_prebuilt;
+    std::unique_ptr<knncolle::Searcher<int, double, double> > my_searcher;
+    std::vector<int> my_test_i;
+    std::vector<double> my_test_d;
+
+public:
+    // Nearest neighbors of 'query', where reference indices are translated to those of the tested index via 'ids' (if provided).
+    void search(const double* query, int k, std::vector<int>& indices, std::vector<double>& distances, const std::vector<int>* ids = NULL) {
+        my_searcher->search(query, k, &indices, &distances);
+        translate(indices, ids);
+    }
+
+    // Nearest neighbors of the 'x'-th reference observation, excluding itself.
+    void search(int x, int k, std::vector<int>& indices, std::vector<double>& distances, const std::vector<int>* ids = NULL) {
+        my_searcher->search(x, k, &indices, &distances);
+        translate(indices, ids);
+    }
+
+    // Checks search() and search_all() for every 'step'-th reference observation, used as a query by its index.
+    // If provided, 'ids' contains the index of each reference observation in the tested index.
+    void compare_by_index(knncolle::Searcher<int, double, double>& searcher, int k, int step = 1, const std::vector<int>* ids = NULL) {
+        std::vector<int> ref_i;
+        std::vector<double> ref_d;
+        for (int x = 0; x < my_obs; x += step) {
+            const int tx = (ids ? (*ids)[x] : x);
+            search(x, k, ref_i, ref_d, ids);
+            searcher.search(tx, k, &my_test_i, &my_test_d);
+            compare(ref_i, ref_d);
+            check_search_all(ref_i, ref_d, [&](double threshold, std::vector<int>* out_i, std::vector<double>* out_d) -> int {
+                return searcher.search_all(tx, threshold, out_i, out_d);
+            });
+        }
+    }
+
+    // Checks search() and search_all() for each row of 'queries'.
+    void compare_by_query(knncolle::Searcher<int, double, double>& searcher, const std::vector<double>& queries, int k, const std::vector<int>* ids = NULL) {
+        std::vector<int> ref_i;
+        std::vector<double> ref_d;
+        const int nqueries = queries.size() / my_dim;
+        for (int q = 0; q < nqueries; ++q) {
+            const auto qptr = queries.data() + q * my_dim;
+            search(qptr, k, ref_i, ref_d, ids);
+            searcher.search(qptr, k, &my_test_i, &my_test_d);
+            compare(ref_i, ref_d);
+            check_search_all(ref_i, ref_d, [&](double threshold, std::vector<int>* out_i, std::vector<double>* out_d) -> int {
+                return searcher.search_all(qptr, threshold, out_i, out_d);
+            });
+        }
+    }
+
+    // Checks search_batch() for all rows of 'queries'.
+    template<class Searcher_>
+    void compare_batch(Searcher_& searcher, const std::vector<double>& queries, int k, const std::vector<int>* ids = NULL) {
+        const int nqueries = queries.size() / my_dim;
+        std::vector<std::vector<int> > batch_i(nqueries);
+        std::vector<std::vector<double> > batch_d(nqueries);
+        searcher.search_batch(queries.data(), nqueries, k, batch_i.data(), batch_d.data());
+
+        std::vector<int> ref_i;
+        std::vector<double> ref_d;
+        for (int q = 0; q < nqueries; ++q) {
+            search(queries.data() + q * my_dim, k, ref_i, ref_d, ids);
+            EXPECT_EQ(batch_i[q], ref_i);
+            EXPECT_EQ(batch_d[q], ref_d);
+        }
+    }
+
+private:
+    static void translate(std::vector<int>& indices, const std::vector<int>* ids) {
+        if (ids) {
+            for (auto& i : indices) {
+                i = (*ids)[i];
+            }
+        }
+    }
+
+    void compare(const std::vector<int>& ref_i, const std::vector<double>& ref_d) const {
+        EXPECT_EQ(my_test_i, ref_i);
+        EXPECT_EQ(my_test_d, ref_d);
+    }
+
+    // Setting the threshold in between two neighbors to avoid problems with round-off.
+    template<class SearchAll_>
+    void check_search_all(std::vector<int> ref_i, std::vector<double> ref_d, SearchAll_ search_all) {
+        const std::size_t num = ref_i.size() / 2;
+        if (num == 0 || num >= ref_d.size() || ref_d[num - 1] == ref_d[num]) {
+            return;
+        }
+        const double threshold = (ref_d[num - 1] + ref_d[num]) / 2;
+        ref_i.resize(num);
+        ref_d.resize(num);
+        EXPECT_EQ(search_all(threshold, NULL, NULL), static_cast<int>(num));
+        search_all(threshold, &my_test_i, &my_test_d);
+        compare(ref_i, ref_d);
+    }
 };
 
 #endif
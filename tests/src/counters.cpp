@@ -0,0 +1,197 @@
+#include <gtest/gtest.h>
+
+// This file is compiled into a separate executable, as the macro must be consistently defined across all translation units.
+#define KNNCOLLE_KMKNN_COUNTERS
+#include "knncolle_kmknn/knncolle_kmknn.hpp"
+
+#include <vector>
+#include <random>
+#include <memory>
+#include <thread>
+
+class KmknnCountersTest : public ::testing::Test {
+protected:
+    inline static int ndim = 5, nobs = 500;
+    inline static std::vector<double> data;
+
+    static void SetUpTestSuite() {
+        std::mt19937_64 rng(99);
+        std::normal_distribution distr;
+        data.resize(ndim * nobs);
+        for (int i = 0; i < nobs; ++i) {
+            for (int d = 0; d < ndim; ++d) {
+                data[i * ndim + d] = distr(rng) + (i % 5) * 10;
+            }
+        }
+    }
+};
+
+TEST_F(KmknnCountersTest, Search) {
+    EXPECT_TRUE(knncolle_kmknn::search_counters_enabled);
+
+    auto eucdist = std::make_shared<knncolle::EuclideanDistance<double, double> >();
+    knncolle::SimpleMatrix<int, double> mat(ndim, nobs, data.data());
+    knncolle::BruteforceBuilder<int, double, double> bb(eucdist);
+    auto bptr = bb.build_unique(mat);
+    auto bsptr = bptr->initialize();
+    knncolle_kmknn::KmknnBuilder<int, double, double> kb(eucdist, eucdist);
+    auto kptr = kb.build_known_unique(mat);
+    auto ksptr = kptr->initialize_known();
+
+    const auto& counters = ksptr->get_counters();
+    EXPECT_EQ(counters.centers_evaluated, 0);
+    EXPECT_EQ(counters.subjects_scanned, 0);
+
+    // Instrumentation has no effect on the results.
+    std::vector<int> kres_i, ref_i;
+    std::vector<double> kres_d, ref_d;
+    ksptr->search(0, 10, &kres_i, &kres_d);
+    bsptr->search(0, 10, &ref_i, &ref_d);
+    EXPECT_EQ(kres_i, ref_i);
+    EXPECT_EQ(kres_d, ref_d);
+
+    // All centers are evaluated for a single query in the absence of super-centers.
+    const auto ncenters = counters.centers_evaluated;
+    EXPECT_GT(ncenters, 0);
+    EXPECT_GE(counters.queue_additions, 11);
+    EXPECT_GE(counters.subjects_scanned, counters.queue_additions);
+    EXPECT_GT(counters.threshold_tightenings, 0);
+    EXPECT_LE(counters.centers_skipped + counters.annulus_skipped, ncenters);
+
+    // Well-separated clusters mean that most clusters should be skipped.
+    for (int x = 1; x < nobs; ++x) {
+        ksptr->search(x, 5, &kres_i, &kres_d);
+    }
+    EXPECT_EQ(counters.centers_evaluated, ncenters * nobs);
+    EXPECT_GT(counters.centers_skipped, 0);
+    EXPECT_LT(counters.subjects_scanned, static_cast<std::size_t>(nobs) * nobs);
+
+    ksptr->reset_counters();
+    EXPECT_EQ(counters.centers_evaluated, 0);
+    EXPECT_EQ(counters.super_centers_evaluated, 0);
+    EXPECT_EQ(counters.centers_skipped, 0);
+    EXPECT_EQ(counters.subjects_scanned, 0);
+    EXPECT_EQ(counters.queue_additions, 0);
+    EXPECT_EQ(counters.threshold_tightenings, 0);
+    EXPECT_EQ(counters.binary_search_trims, 0);
+    EXPECT_EQ(counters.pivot_skipped, 0);
+
+    // search_all() reports each neighbor as a queue addition, including the query itself.
+    const double threshold = (ref_d[4] + ref_d[5]) / 2;
+    EXPECT_EQ(ksptr->search_all(data.data(), threshold, NULL, NULL), 6);
+    EXPECT_EQ(counters.queue_additions, 6);
+    EXPECT_EQ(counters.centers_evaluated, ncenters);
+    EXPECT_GT(counters.centers_skipped, 0);
+    EXPECT_GT(counters.binary_search_trims, 0);
+
+    // A query that is far away from everything should skip all clusters.
+    ksptr->reset_counters();
+    std::vector<double> far(ndim, 1000);
+    EXPECT_EQ(ksptr->search_all(far.data(), 1, NULL, NULL), 0);
+    EXPECT_EQ(counters.centers_skipped, ncenters);
+    EXPECT_EQ(counters.subjects_scanned, 0);
+}
+
+TEST_F(KmknnCountersTest, Pivots) {
+    auto eucdist = std::make_shared<knncolle::EuclideanDistance<double, double> >();
+    knncolle::SimpleMatrix<int, double> mat(ndim, nobs, data.data());
+    knncolle_kmknn::KmknnBuilder<int, double, double> kb(eucdist, eucdist);
+    auto kptr = kb.build_known_unique(mat);
+    auto ksptr = kptr->initialize_known();
+    kb.get_options().num_pivots = 2;
+    auto pptr = kb.build_known_unique(mat);
+    auto psptr = pptr->initialize_known();
+
+    std::vector<int> kres_i, pres_i;
+    std::vector<double> kres_d, pres_d;
+    for (int x = 0; x < nobs; ++x) {
+        ksptr->search(x, 5, &kres_i, &kres_d);
+        psptr->search(x, 5, &pres_i, &pres_d);
+        EXPECT_EQ(kres_i, pres_i);
+        EXPECT_EQ(kres_d, pres_d);
+    }
+
+    // Pivots do not change the subjects that are scanned, only whether their full distances need to be computed.
+    const auto& ref = ksptr->get_counters();
+    const auto& counters = psptr->get_counters();
+    EXPECT_EQ(ref.pivot_skipped, 0);
+    EXPECT_GT(counters.pivot_skipped, 0);
+    EXPECT_LT(counters.pivot_skipped, counters.subjects_scanned);
+    EXPECT_EQ(counters.subjects_scanned, ref.subjects_scanned);
+}
+
+TEST_F(KmknnCountersTest, SuperCenters) {
+    auto eucdist = std::make_shared<knncolle::EuclideanDistance<double, double> >();
+    knncolle::SimpleMatrix<int, double> mat(ndim, nobs, data.data());
+    knncolle_kmknn::KmknnBuilder<int, double, double> kb(eucdist, eucdist);
+    kb.get_options().super_center_power = 0.5;
+    auto kptr = kb.build_known_unique(mat);
+    auto ksptr = kptr->initialize_known();
+
+    std::vector<int> indices;
+    std::vector<double> distances;
+    ksptr->search(0, 5, &indices, &distances);
+    const auto& counters = ksptr->get_counters();
+    const auto nsuper = counters.super_centers_evaluated;
+    EXPECT_GT(nsuper, 0);
+
+    // All super-centers are evaluated for each query, while only the centers in the unskipped super-centers are evaluated.
+    for (int x = 1; x < nobs; ++x) {
+        ksptr->search(x, 5, &indices, &distances);
+    }
+    EXPECT_EQ(counters.super_centers_evaluated, nsuper * nobs);
+    EXPECT_GT(counters.centers_evaluated, 0);
+
+    ksptr->reset_counters();
+    ksptr->search_all(data.data(), 1, NULL, NULL);
+    EXPECT_EQ(counters.super_centers_evaluated, nsuper);
+}
+
+TEST_F(KmknnCountersTest, Aggregation) {
+    auto eucdist = std::make_shared<knncolle::EuclideanDistance<double, double> >();
+    knncolle::SimpleMatrix<int, double> mat(ndim, nobs, data.data());
+    knncolle_kmknn::KmknnBuilder<int, double, double> kb(eucdist, eucdist);
+    auto kptr = kb.build_known_unique(mat);
+
+    // Reference counters from a single searcher.
+    auto ref = kptr->initialize_known();
+    std::vector<int> indices;
+    std::vector<double> distances;
+    for (int x = 0; x < nobs; ++x) {
+        ref->search(x, 5, &indices, &distances);
+    }
+
+    // Splitting the queries across threads with one searcher per thread, and then combining their counters.
+    constexpr int nthreads = 3;
+    std::vector<knncolle_kmknn::KmknnSearchCounters> per_thread(nthreads);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < nthreads; ++t) {
+        workers.emplace_back([&](int t) -> void {
+            auto searcher = kptr->initialize_known();
+            std::vector<int> indices;
+            std::vector<double> distances;
+            for (int x = t; x < nobs; x += nthreads) {
+                searcher->search(x, 5, &indices, &distances);
+            }
+            per_thread[t] = searcher->get_counters();
+        }, t);
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+
+    knncolle_kmknn::KmknnSearchCounters combined;
+    for (const auto& p : per_thread) {
+        combined += p;
+    }
+    const auto& expected = ref->get_counters();
+    EXPECT_EQ(combined.centers_evaluated, expected.centers_evaluated);
+    EXPECT_EQ(combined.super_centers_evaluated, expected.super_centers_evaluated);
+    EXPECT_EQ(combined.centers_skipped, expected.centers_skipped);
+    EXPECT_EQ(combined.annulus_skipped, expected.annulus_skipped);
+    EXPECT_EQ(combined.subjects_scanned, expected.subjects_scanned);
+    EXPECT_EQ(combined.pivot_skipped, expected.pivot_skipped);
+    EXPECT_EQ(combined.queue_additions, expected.queue_additions);
+    EXPECT_EQ(combined.threshold_tightenings, expected.threshold_tightenings);
+    EXPECT_EQ(combined.binary_search_trims, expected.binary_search_trims);
+}
@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+
+#include "TestCore.h"
+
+#include "knncolle_kmknn/knncolle_kmknn.hpp"
+
+#include <vector>
+#include <cstddef>
+#include <limits>
+#include <tuple>
+#include <cstdint>
+
+// Checking that the kernels give exactly the same results as raw(), which requires the same order of summation over the dimensions.
+// We use non-integer data so that any change in the summation order would be visible as round-off error.
+class KmknnKernelsTest : public TestCore, public ::testing::TestWithParam<std::tuple<int, int> > {
+protected:
+    void SetUp() {
+        assemble(GetParam());
+    }
+
+    static constexpr std::size_t block = knncolle_kmknn::kernel_block_size<double>();
+
+    template<class Metric_>
+    void compare(knncolle_kmknn::DistanceKind kind, const Metric_& metric) {
+        std::vector<double> query(ndim);
+        std::mt19937_64 rng(ndim * 3 + nobs);
+        fill_random(query.begin(), query.end(), rng);
+
+        std::vector<double> expected(nobs);
+        for (int s = 0; s < nobs; ++s) {
+            expected[s] = metric.raw(ndim, query.data(), data.data() + s * ndim);
+        }
+
+        // Blocked kernels on the row-major data, including the leftover subjects that don't fill a block.
+        std::vector<double> observed(nobs);
+        knncolle_kmknn::compute_raw_distances(kind, metric, ndim, query.data(), data.data(), nobs, observed.data());
+        EXPECT_EQ(observed, expected);
+
+        // Tiled kernels, after transposing the data into padded tiles.
+        const std::size_t ntiles = (nobs + block - 1) / block;
+        const std::size_t stride = knncolle_kmknn::tile_stride<double, double>(ndim);
+        EXPECT_GE(stride, ndim * block);
+        EXPECT_EQ(stride * sizeof(double) % knncolle_kmknn::tile_alignment, 0);
+
+        std::vector<double, knncolle_kmknn::AlignedAllocator<double> > tiles(ntiles * stride);
+        EXPECT_EQ(reinterpret_cast<std::uintptr_t>(tiles.data()) % knncolle_kmknn::tile_alignment, 0);
+        for (int s = 0; s < nobs; ++s) {
+            for (int d = 0; d < ndim; ++d) {
+                tiles[(s / block) * stride + d * block + s % block] = data[s * ndim + d];
+            }
+        }
+        std::vector<double> buffer(block);
+        for (std::size_t t = 0; t < ntiles; ++t) {
+            knncolle_kmknn::compute_tiled_raw_distances(kind, ndim, query.data(), tiles.data() + t * stride, buffer.data());
+            for (std::size_t b = 0; b < block && t * block + b < static_cast<std::size_t>(nobs); ++b) {
+                EXPECT_EQ(buffer[b], expected[t * block + b]);
+            }
+        }
+
+        // Early abandonment gives the same result when the threshold is never exceeded.
+        for (int s = 0; s < nobs; ++s) {
+            const auto dist = knncolle_kmknn::compute_raw_distance_early_abandon(
+                kind,
+                metric,
+                ndim,
+                query.data(),
+                data.data() + s * ndim,
+                3,
+                std::numeric_limits<double>::infinity()
+            );
+            EXPECT_EQ(dist, expected[s]);
+        }
+    }
+};
+
+TEST_P(KmknnKernelsTest, Euclidean) {
+    knncolle::EuclideanDistance<double, double> metric;
+    compare(knncolle_kmknn::DistanceKind::EUCLIDEAN, metric);
+}
+
+TEST_P(KmknnKernelsTest, Manhattan) {
+    knncolle::ManhattanDistance<double, double> metric;
+    compare(knncolle_kmknn::DistanceKind::MANHATTAN, metric);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    KmknnKernels,
+    KmknnKernelsTest,
+    ::testing::Combine(
+        ::testing::Values(1, 13, 50), // number of subjects, mostly not a multiple of the block size.
+        ::testing::Values(1, 3, 7, 17, 31) // number of dimensions, not a multiple of the block size.
+    )
+);
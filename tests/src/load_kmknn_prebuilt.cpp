@@ -7,6 +7,9 @@
 #include <filesystem>
 #include <memory>
 #include <vector>
+#include <fstream>
+#include <string>
+#include <numeric>
 
 class KmknnLoadPrebuiltTest : public TestCore, public ::testing::Test {
 protected:
@@ -53,6 +56,478 @@ TEST_F(KmknnLoadPrebuiltTest, Euclidean) {
     }
 }
 
+TEST_F(KmknnLoadPrebuiltTest, Options) {
+    auto eucdist = std::make_shared<knncolle::EuclideanDistance<double, double> >();
+    knncolle_kmknn::KmknnBuilder<int, double, double> kb(eucdist, eucdist);
+    kb.get_options().early_abandon_block = 2;
+    kb.get_options().quantize = true;
+    auto bptr = kb.build_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+
+    const auto dir = savedir / "options";
+    std::filesystem::create_directory(dir);
+    bptr->save(dir);
+
+    size_t early = 0;
+    knncolle::quick_load(dir / "EARLY_ABANDON", &early, 1);
+    EXPECT_EQ(early, 2);
+    EXPECT_TRUE(std::filesystem::exists(dir / "QUANTIZED"));
+
+    std::vector<int> output_i, output_i2;
+    std::vector<double> output_d, output_d2;
+    auto searcher = bptr->initialize();
+    {
+        auto reloaded = knncolle::load_prebuilt_shared<int, double, double>(dir);
+        auto researcher = reloaded->initialize();
+        for (int x = 0; x < nobs; ++x) {
+            searcher->search(x, 5, &output_i, &output_d);
+            researcher->search(x, 5, &output_i2, &output_d2);
+            EXPECT_EQ(output_i, output_i2);
+            EXPECT_EQ(output_d, output_d2);
+        }
+    }
+
+    // Still works without the optional files.
+    std::filesystem::remove(dir / "EARLY_ABANDON");
+    std::filesystem::remove(dir / "QUANTIZED");
+    {
+        auto reloaded = knncolle::load_prebuilt_shared<int, double, double>(dir);
+        auto researcher = reloaded->initialize();
+        for (int x = 0; x < nobs; ++x) {
+            searcher->search(x, 5, &output_i, &output_d);
+            researcher->search(x, 5, &output_i2, &output_d2);
+            EXPECT_EQ(output_i, output_i2);
+            EXPECT_EQ(output_d, output_d2);
+        }
+    }
+}
+
+TEST_F(KmknnLoadPrebuiltTest, MemoryMapped) {
+    auto eucdist = std::make_shared<knncolle::EuclideanDistance<double, double> >();
+    knncolle_kmknn::KmknnBuilder<int, double, double> kb(eucdist, eucdist);
+    kb.get_options().quantize = true;
+    auto bptr = kb.build_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+
+    const auto dir = savedir / "mapped";
+    std::filesystem::create_directory(dir);
+    bptr->save(dir);
+
+    knncolle_kmknn::KmknnLoadOptions lopt;
+    lopt.memory_map = true;
+    std::unique_ptr<knncolle::Prebuilt<int, double, double> > reloaded(knncolle_kmknn::load_kmknn_prebuilt<int, double, double>(dir, lopt));
+    EXPECT_EQ(reloaded->num_observations(), nobs);
+    EXPECT_EQ(reloaded->num_dimensions(), ndim);
+
+    std::vector<int> output_i, output_i2;
+    std::vector<double> output_d, output_d2;
+    auto searcher = bptr->initialize();
+    auto researcher = reloaded->initialize();
+    std::vector<double> query(ndim);
+    for (int x = 0; x < nobs; ++x) {
+        searcher->search(x, 5, &output_i, &output_d);
+        researcher->search(x, 5, &output_i2, &output_d2);
+        EXPECT_EQ(output_i, output_i2);
+        EXPECT_EQ(output_d, output_d2);
+
+        std::fill(query.begin(), query.end(), x * 0.01);
+        searcher->search(query.data(), 5, &output_i, &output_d);
+        researcher->search(query.data(), 5, &output_i2, &output_d2);
+        EXPECT_EQ(output_i, output_i2);
+        EXPECT_EQ(output_d, output_d2);
+    }
+
+    // Saving a memory-mapped index works as expected.
+    const auto dir2 = savedir / "mapped2";
+    std::filesystem::create_directory(dir2);
+    reloaded->save(dir2);
+    EXPECT_EQ(knncolle::quick_load_as_string(dir / "DATA"), knncolle::quick_load_as_string(dir2 / "DATA"));
+    EXPECT_EQ(knncolle::quick_load_as_string(dir / "QUANTIZED"), knncolle::quick_load_as_string(dir2 / "QUANTIZED"));
+
+    // Errors out if the files are truncated.
+    knncolle::quick_save(dir / "DATA", data.data(), 1);
+    std::string msg;
+    try {
+        knncolle_kmknn::load_kmknn_prebuilt<int, double, double>(dir, lopt);
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_TRUE(msg.find("too small") != std::string::npos);
+}
+
+TEST_F(KmknnLoadPrebuiltTest, MemoryMappedAdd) {
+    auto eucdist = std::make_shared<knncolle::EuclideanDistance<double, double> >();
+    knncolle_kmknn::KmknnBuilder<int, double, double> kb(eucdist, eucdist);
+    auto bptr = kb.build_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+
+    const auto dir = savedir / "mapped_add";
+    std::filesystem::create_directory(dir);
+    bptr->save(dir);
+    const auto original = knncolle::quick_load_as_string(dir / "DATA");
+
+    // Adding new observations with multiple threads, which should only read from the mapped arrays.
+    const int nnew = 200;
+    auto combined = data;
+    const auto extra = simulate(nnew, ndim, 12345);
+    combined.insert(combined.end(), extra.begin(), extra.end());
+
+    knncolle_kmknn::KmknnLoadOptions lopt;
+    lopt.memory_map = true;
+    for (int deleted = 0; deleted < 2; ++deleted) {
+        std::unique_ptr<knncolle_kmknn::KmknnPrebuilt<int, double, double, knncolle::DistanceMetric<double, double>, double, knncolle::DistanceMetric<double, double> > > reloaded(
+            knncolle_kmknn::load_kmknn_prebuilt<int, double, double>(dir, lopt)
+        );
+        if (deleted) {
+            reloaded->remove(0);
+        }
+
+        knncolle_kmknn::KmknnOptions<int, double, double> aopt;
+        aopt.num_threads = 3;
+        reloaded->add(nnew, extra.data(), aopt);
+        EXPECT_EQ(reloaded->num_observations(), nobs + nnew);
+        EXPECT_EQ(reloaded->num_deleted(), deleted);
+
+        std::vector<int> keep(nobs + nnew);
+        std::iota(keep.begin(), keep.end(), 0);
+        keep.erase(keep.begin(), keep.begin() + deleted);
+        const auto kept_data = subset_rows(combined, ndim, keep);
+        BruteforceReference ref(ndim, keep.size(), kept_data.data(), eucdist);
+        ref.compare_by_index(*(reloaded->initialize()), 5, 1, &keep);
+    }
+
+    EXPECT_EQ(knncolle::quick_load_as_string(dir / "DATA"), original);
+}
+
+TEST_F(KmknnLoadPrebuiltTest, MemoryMappedRemove) {
+    auto eucdist = std::make_shared<knncolle::EuclideanDistance<double, double> >();
+    knncolle_kmknn::KmknnBuilder<int, double, double> kb(eucdist, eucdist);
+    auto bptr = kb.build_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+
+    const auto dir = savedir / "mapped_remove";
+    std::filesystem::create_directory(dir);
+    bptr->save(dir);
+    const auto original = knncolle::quick_load_as_string(dir / "NEW_LOCATION");
+
+    knncolle_kmknn::KmknnLoadOptions lopt;
+    lopt.memory_map = true;
+    std::unique_ptr<knncolle_kmknn::KmknnPrebuilt<int, double, double, knncolle::DistanceMetric<double, double>, double, knncolle::DistanceMetric<double, double> > > reloaded(
+        knncolle_kmknn::load_kmknn_prebuilt<int, double, double>(dir, lopt)
+    );
+
+    std::vector<int> keep;
+    for (int x = 0; x < nobs; ++x) {
+        if (x % 4 == 0) {
+            reloaded->remove(x);
+        } else {
+            keep.push_back(x);
+        }
+    }
+    const auto kept_data = subset_rows(data, ndim, keep);
+    BruteforceReference ref(ndim, keep.size(), kept_data.data(), eucdist);
+    ref.compare_by_index(*(reloaded->initialize()), 5, 1, &keep);
+
+    EXPECT_EQ(reloaded->compact(), keep);
+    ref.compare_by_index(*(reloaded->initialize()), 5);
+    EXPECT_EQ(knncolle::quick_load_as_string(dir / "NEW_LOCATION"), original);
+}
+
+TEST_F(KmknnLoadPrebuiltTest, SingleFile) {
+    auto mandist = std::make_shared<knncolle::ManhattanDistance<double, double> >();
+    knncolle_kmknn::KmknnBuilder<int, double, double> kb(mandist, mandist);
+    kb.get_options().quantize = true;
+    auto bptr = kb.build_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+
+    const auto path = savedir / "single.kmknn";
+    knncolle_kmknn::save_kmknn_prebuilt_file(*bptr, path);
+    EXPECT_TRUE(std::filesystem::is_regular_file(path));
+    EXPECT_FALSE(std::filesystem::exists(savedir / "single.kmknn.tmp"));
+
+    auto config = knncolle_kmknn::load_kmknn_prebuilt_file_types(path);
+    EXPECT_EQ(config.kmeansfloat, knncolle::NumericType::DOUBLE);
+
+    // All sections should be aligned.
+    knncolle_kmknn::ContainerReader reader(path, true);
+    EXPECT_TRUE(reader.has("DATA"));
+    EXPECT_TRUE(reader.has("DISTANCE_DATA/DISTANCE"));
+    for (const auto& sec : reader.sections()) {
+        EXPECT_EQ(sec.offset % knncolle_kmknn::container_alignment, 0);
+    }
+
+    auto searcher = bptr->initialize();
+    std::vector<int> output_i, output_i2;
+    std::vector<double> output_d, output_d2;
+    for (int mapped = 0; mapped < 2; ++mapped) {
+        knncolle_kmknn::KmknnLoadOptions lopt;
+        lopt.memory_map = mapped;
+        std::unique_ptr<knncolle::Prebuilt<int, double, double> > reloaded(knncolle_kmknn::load_kmknn_prebuilt_file<int, double, double>(path, lopt));
+        auto researcher = reloaded->initialize();
+        for (int x = 0; x < nobs; ++x) {
+            searcher->search(x, 5, &output_i, &output_d);
+            researcher->search(x, 5, &output_i2, &output_d2);
+            EXPECT_EQ(output_i, output_i2);
+            EXPECT_EQ(output_d, output_d2);
+        }
+    }
+
+    // Matches the contents of a save() directory.
+    const auto dir = savedir / "single";
+    std::filesystem::create_directory(dir);
+    bptr->save(dir);
+    EXPECT_EQ(knncolle::quick_load_as_string(dir / "DATA"), reader.load_as_string("DATA"));
+    EXPECT_EQ(knncolle::quick_load_as_string(dir / "DISTANCE_CENTER" / "DISTANCE"), reader.load_as_string("DISTANCE_CENTER/DISTANCE"));
+    std::size_t nfiles = 0;
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(dir)) {
+        nfiles += entry.is_regular_file();
+    }
+    EXPECT_EQ(nfiles, reader.sections().size());
+    for (const auto& sec : reader.sections()) {
+        EXPECT_EQ(knncolle::quick_load_as_string(dir / sec.name), reader.load_as_string(sec.name));
+    }
+}
+
+class ScaledEuclideanDistance final : public knncolle::DistanceMetric<double, double> {
+public:
+    ScaledEuclideanDistance(double scale) : my_scale(scale) {}
+    double raw(std::size_t num_dimensions, const double* x, const double* y) const {
+        return my_ref.raw(num_dimensions, x, y) * my_scale * my_scale;
+    }
+    double normalize(double raw) const {
+        return my_ref.normalize(raw);
+    }
+    double denormalize(double norm) const {
+        return my_ref.denormalize(norm);
+    }
+    void save(const std::filesystem::path& dir) const {
+        knncolle::quick_save(dir / "DISTANCE", "scaled_euclidean", 16);
+        knncolle::quick_save(dir / "SCALE", &my_scale, 1);
+    }
+private:
+    double my_scale;
+    knncolle::EuclideanDistance<double, double> my_ref;
+};
+
+// Same as above but only saves the name, to check that the loading function still gets a real directory.
+class NamedOnlyDistance final : public knncolle::DistanceMetric<double, double> {
+public:
+    double raw(std::size_t num_dimensions, const double* x, const double* y) const {
+        return my_ref.raw(num_dimensions, x, y);
+    }
+    double normalize(double raw) const {
+        return my_ref.normalize(raw);
+    }
+    double denormalize(double norm) const {
+        return my_ref.denormalize(norm);
+    }
+    void save(const std::filesystem::path& dir) const {
+        knncolle::quick_save(dir / "DISTANCE", "named_euclidean", 15);
+    }
+private:
+    knncolle::EuclideanDistance<double, double> my_ref;
+};
+
+TEST_F(KmknnLoadPrebuiltTest, SingleFileCustomDistance) {
+    // Metrics that save more than their name are loaded from a directory of their files.
+    auto& registry = knncolle::load_distance_metric_registry<double, double>();
+    registry["scaled_euclidean"] = [](const std::filesystem::path& dir) -> knncolle::DistanceMetric<double, double>* {
+        double scale;
+        knncolle::quick_load(dir / "SCALE", &scale, 1);
+        return new ScaledEuclideanDistance(scale);
+    };
+
+    auto scaled = std::make_shared<ScaledEuclideanDistance>(2.5);
+    knncolle_kmknn::KmknnBuilder<int, double, double> kb(scaled, scaled);
+    auto bptr = kb.build_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+
+    const auto path = savedir / "custom_distance.kmknn";
+    knncolle_kmknn::save_kmknn_prebuilt_file(*bptr, path);
+    knncolle_kmknn::ContainerReader reader(path, true);
+    EXPECT_TRUE(reader.has("DISTANCE_DATA/SCALE"));
+
+    std::unique_ptr<knncolle::Prebuilt<int, double, double> > reloaded(knncolle_kmknn::load_kmknn_prebuilt_file<int, double, double>(path));
+    std::vector<int> output_i, output_i2;
+    std::vector<double> output_d, output_d2;
+    auto searcher = bptr->initialize();
+    auto researcher = reloaded->initialize();
+    for (int x = 0; x < nobs; ++x) {
+        searcher->search(x, 5, &output_i, &output_d);
+        researcher->search(x, 5, &output_i2, &output_d2);
+        EXPECT_EQ(output_i, output_i2);
+        EXPECT_EQ(output_d, output_d2);
+    }
+
+    // Metrics that only save their name are also loaded from a real directory, in case the loading function reads it.
+    registry["named_euclidean"] = [](const std::filesystem::path& dir) -> knncolle::DistanceMetric<double, double>* {
+        EXPECT_EQ(knncolle::quick_load_as_string(dir / "DISTANCE"), std::string("named_euclidean"));
+        return new NamedOnlyDistance;
+    };
+    auto named_only = std::make_shared<NamedOnlyDistance>();
+    knncolle_kmknn::KmknnBuilder<int, double, double> nb(named_only, named_only);
+    auto nptr = nb.build_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+    const auto named_path = savedir / "named_distance.kmknn";
+    knncolle_kmknn::save_kmknn_prebuilt_file(*nptr, named_path);
+    EXPECT_FALSE(knncolle_kmknn::ContainerReader(named_path, true).has("DISTANCE_DATA/SCALE"));
+    std::unique_ptr<knncolle::Prebuilt<int, double, double> > named_reloaded(knncolle_kmknn::load_kmknn_prebuilt_file<int, double, double>(named_path));
+    EXPECT_EQ(named_reloaded->num_observations(), nobs);
+    registry.erase("named_euclidean");
+
+    registry.erase("scaled_euclidean");
+    std::string msg;
+    try {
+        knncolle_kmknn::load_kmknn_prebuilt_file<int, double, double>(path);
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_FALSE(msg.empty());
+}
+
+TEST_F(KmknnLoadPrebuiltTest, SingleFileErrors) {
+    auto eucdist = std::make_shared<knncolle::EuclideanDistance<double, double> >();
+    knncolle_kmknn::KmknnBuilder<int, double, double> kb(eucdist, eucdist);
+    auto bptr = kb.build_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+
+    const auto path = savedir / "corrupted.kmknn";
+    auto expect_error = [&](const std::string& expected, bool verify) -> void {
+        knncolle_kmknn::KmknnLoadOptions lopt;
+        lopt.verify_checksums = verify;
+        std::string msg;
+        try {
+            std::unique_ptr<knncolle::Prebuilt<int, double, double> > ptr(knncolle_kmknn::load_kmknn_prebuilt_file<int, double, double>(path, lopt));
+        } catch (std::exception& e) {
+            msg = e.what();
+        }
+        EXPECT_TRUE(msg.find(expected) != std::string::npos) << msg;
+    };
+
+    auto modify = [&](std::size_t offset, char value) -> void {
+        std::fstream handle(path, std::ios::binary | std::ios::in | std::ios::out);
+        handle.seekp(offset);
+        handle.write(&value, 1);
+    };
+
+    knncolle_kmknn::save_kmknn_prebuilt_file(*bptr, path);
+    modify(0, 'X');
+    expect_error("not a KMKNN index", true);
+
+    knncolle_kmknn::save_kmknn_prebuilt_file(*bptr, path);
+    modify(8, 99);
+    expect_error("unsupported version", true);
+
+    knncolle_kmknn::save_kmknn_prebuilt_file(*bptr, path);
+    modify(22, 'x'); // somewhere in the first section name.
+    expect_error("checksum mismatch for the header", true);
+
+    // Implausibly large number of sections, which should fail before any allocation.
+    knncolle_kmknn::save_kmknn_prebuilt_file(*bptr, path);
+    modify(15, 0x7f);
+    expect_error("truncated header", true);
+
+    // Corrupting the last byte of the data.
+    knncolle_kmknn::save_kmknn_prebuilt_file(*bptr, path);
+    std::uint64_t last = 0;
+    {
+        knncolle_kmknn::ContainerReader reader(path, true);
+        for (const auto& sec : reader.sections()) {
+            if (sec.name == "DATA") {
+                last = sec.offset + sec.size - 1;
+            }
+        }
+    }
+    modify(last, 'x');
+    expect_error("checksum mismatch for section 'DATA'", true);
+    expect_error("", false);
+
+    // Not a KMKNN index.
+    {
+        knncolle_kmknn::ContainerWriter writer;
+        writer.save("ALGORITHM", "foo", 3);
+        writer.write(path);
+        expect_error("does not contain a KMKNN index", true);
+    }
+}
+
+TEST_F(KmknnLoadPrebuiltTest, Streaming) {
+    auto eucdist = std::make_shared<knncolle::EuclideanDistance<double, double> >();
+    knncolle::SimpleMatrix<int, double> mat(ndim, nobs, data.data());
+    knncolle::BruteforceBuilder<int, double, double> bb(eucdist);
+    auto bptr = bb.build_unique(mat);
+    auto bsearcher = bptr->initialize();
+
+    knncolle_kmknn::KmknnBuilder<int, double, double> kb(eucdist, eucdist);
+    kb.get_options().kmeans_subsample_size = 20;
+    knncolle_kmknn::KmknnStreamingOptions sopt;
+    sopt.buffer_size = sizeof(double) * ndim * 7; // forcing multiple passes, with a partial chunk at the end.
+
+    const auto dir = savedir / "streaming";
+    std::filesystem::create_directory(dir);
+    auto streamed = kb.build_streaming_unique(mat, dir, sopt);
+    EXPECT_EQ(streamed->num_observations(), nobs);
+    EXPECT_EQ(streamed->num_dimensions(), ndim);
+
+    knncolle_kmknn::KmknnLoadOptions lopt;
+    lopt.memory_map = true;
+    std::unique_ptr<knncolle::Prebuilt<int, double, double> > reloaded(knncolle_kmknn::load_kmknn_prebuilt<int, double, double>(dir, lopt));
+
+    std::vector<int> output_i, ref_i;
+    std::vector<double> output_d, ref_d;
+    auto searcher = streamed->initialize();
+    auto researcher = reloaded->initialize();
+    for (int x = 0; x < nobs; ++x) {
+        bsearcher->search(x, 5, &ref_i, &ref_d);
+        searcher->search(x, 5, &output_i, &output_d);
+        EXPECT_EQ(output_i, ref_i);
+        EXPECT_EQ(output_d, ref_d);
+        researcher->search(x, 5, &output_i, &output_d);
+        EXPECT_EQ(output_i, ref_i);
+        EXPECT_EQ(output_d, ref_d);
+    }
+
+    // Same results with a buffer that holds everything, in which case the subsample is also the entire dataset.
+    kb.get_options().kmeans_subsample_size = 0;
+    const auto dir2 = savedir / "streaming2";
+    std::filesystem::create_directory(dir2);
+    auto streamed2 = kb.build_streaming_unique(mat, dir2);
+    auto searcher2 = streamed2->initialize();
+    for (int x = 0; x < nobs; ++x) {
+        bsearcher->search(x, 5, &ref_i, &ref_d);
+        searcher2->search(x, 5, &output_i, &output_d);
+        EXPECT_EQ(output_i, ref_i);
+        EXPECT_EQ(output_d, ref_d);
+    }
+
+    // Each option that requires random access to the observations is rejected.
+    auto expect_rejected = [&](auto modify) -> void {
+        knncolle_kmknn::KmknnBuilder<int, double, double> rejector(eucdist, eucdist);
+        modify(rejector.get_options());
+        EXPECT_ANY_THROW(rejector.build_streaming_unique(mat, dir2));
+    };
+    expect_rejected([](auto& opt) -> void { opt.candidate_powers = std::vector<double>{ 0.4, 0.5 }; });
+    expect_rejected([](auto& opt) -> void { opt.max_cluster_size = 10; });
+    expect_rejected([](auto& opt) -> void { opt.super_center_power = 0.5; });
+    expect_rejected([](auto& opt) -> void { opt.quantize = true; });
+    expect_rejected([](auto& opt) -> void { opt.reorder_dimensions = true; });
+    expect_rejected([](auto& opt) -> void { opt.tile_subjects = true; });
+}
+
+TEST_F(KmknnLoadPrebuiltTest, StreamingEmpty) {
+    auto eucdist = std::make_shared<knncolle::EuclideanDistance<double, double> >();
+    knncolle::SimpleMatrix<int, double> mat(ndim, 0, data.data());
+    knncolle_kmknn::KmknnBuilder<int, double, double> kb(eucdist, eucdist);
+
+    const auto dir = savedir / "streaming_empty";
+    std::filesystem::create_directory(dir);
+    auto streamed = kb.build_streaming_unique(mat, dir);
+    EXPECT_EQ(streamed->num_observations(), 0);
+    EXPECT_EQ(std::filesystem::file_size(dir / "DATA"), 0);
+
+    std::vector<int> output_i;
+    std::vector<double> output_d;
+    auto searcher = streamed->initialize();
+    searcher->search(data.data(), 5, &output_i, &output_d);
+    EXPECT_TRUE(output_i.empty());
+    EXPECT_TRUE(output_d.empty());
+
+    std::unique_ptr<knncolle::Prebuilt<int, double, double> > reloaded(knncolle_kmknn::load_kmknn_prebuilt<int, double, double>(dir));
+    EXPECT_EQ(reloaded->num_observations(), 0);
+}
+
 TEST_F(KmknnLoadPrebuiltTest, Manhattan) {
     auto mandist = std::make_shared<knncolle::ManhattanDistance<double, double> >();
     knncolle_kmknn::KmknnBuilder<int, double, double> kb(mandist, mandist);
@@ -90,6 +565,10 @@ TEST_F(KmknnLoadPrebuiltTest, Custom) {
     bptr->save(dir);
 
     EXPECT_EQ(knncolle::quick_load_as_string(dir / "custom_foo"), "BAR");
+
+    const auto path = savedir / "custom.kmknn";
+    knncolle_kmknn::save_kmknn_prebuilt_file(*bptr, path);
+    EXPECT_EQ(knncolle_kmknn::ContainerReader(path, true).load_as_string("custom_foo"), "BAR");
 }
 
 TEST_F(KmknnLoadPrebuiltTest, Errors) {